@@ -4,9 +4,15 @@
 #include <cstring>
 
 #include "bit_utils.h"
+#include "core_load.h"
 #include "display_modes.h"
+#include "edge_pool.h"
 #include "firmware_version.h"
+#include "raw_stream.h"
+#include "rx_bench.h"
 #include "terminal.h"
+#include "wiegand_format.h"
+#include "wiegand_frame.h"
 #include "wiegand_rx_log.h"
 
 namespace {
@@ -47,6 +53,87 @@ bool parse_hex_string(const char *hex, uint8_t *out, size_t out_cap, size_t &out
     return true;
 }
 
+// Map a port argument ("a", "b", ...) to an index into g_ports, or -1.
+int port_index_from_arg(const char *arg)
+{
+    if (!arg || !g_ports) return -1;
+    const int index = arg[0] - 'a';
+    if (index < 0 || static_cast<size_t>(index) >= g_port_count || arg[1] != '\0') return -1;
+    return index;
+}
+
+// In dual-core builds core1 owns each port's RX state; park it while a command changes that.
+class RxCoreLock
+{
+public:
+    RxCoreLock()
+    {
+#if WIEGAND_DUAL_CORE
+        rp2040.idleOtherCore();
+#endif
+    }
+
+    ~RxCoreLock()
+    {
+#if WIEGAND_DUAL_CORE
+        rp2040.resumeOtherCore();
+#endif
+    }
+};
+
+CoreLoadCounters g_cpu_prev[2] = {};
+
+const char *capture_mode_name(WiegandPort::CaptureMode mode)
+{
+    return (mode == WiegandPort::CaptureMode::Dma) ? "dma" : "irq";
+}
+
+const char *role_name(WiegandPort::Role role)
+{
+    switch (role)
+    {
+    case WiegandPort::Role::Rx: return "rx";
+    case WiegandPort::Role::Tx: return "tx";
+    case WiegandPort::Role::Disabled: return "disabled";
+    case WiegandPort::Role::RxTx:
+    default: return "rxtx";
+    }
+}
+
+const char *trigger_state_name(EdgeTrigger::State state)
+{
+    switch (state)
+    {
+    case EdgeTrigger::State::Armed: return "armed";
+    case EdgeTrigger::State::Filling: return "filling";
+    case EdgeTrigger::State::Frozen: return "frozen";
+    case EdgeTrigger::State::Off:
+    default: return "off";
+    }
+}
+
+const char *trigger_kind_name(EdgeTrigger::Kind kind)
+{
+    switch (kind)
+    {
+    case EdgeTrigger::Kind::PulseWidth: return "pulse";
+    case EdgeTrigger::Kind::BitCount: return "bits";
+    case EdgeTrigger::Kind::Pattern:
+    default: return "pattern";
+    }
+}
+
+const char *rx_program_name(WiegandRxProgram program)
+{
+    switch (program)
+    {
+    case WiegandRxProgram::Pulses: return "pulses";
+    case WiegandRxProgram::Bits: return "bits";
+    case WiegandRxProgram::Edges:
+    default: return "edges";
+    }
+}
+
 bool cmd_ping(int argc, char *argv[])
 {
     (void)argc; (void)argv;
@@ -65,13 +152,31 @@ bool cmd_ver(int argc, char *argv[])
 bool cmd_help(int argc, char *argv[])
 {
     (void)argc; (void)argv;
+    Serial.print("Ports: a-"); Serial.println(static_cast<char>('a' + g_port_count - 1));
     Serial.println("Commands:");
     Serial.println("  ping");
     Serial.println("  ver");
     Serial.println("  help");
-    Serial.println("  pins <a|b|c>");
+    Serial.println("  pins <port>");
     Serial.println("  getrx");
-    Serial.println("  tx <a|b|c> <hexdata> [bits] [bit_us] [inter_us]");
+    Serial.println("  tx <port> <hexdata> [bits] [bit_us] [inter_us]");
+    Serial.println("  role <port> [rxtx|rx|tx|disabled]");
+    Serial.println("  format <port> [reset]");
+    Serial.println("  capture <port> [irq|dma]");
+    Serial.println("  rxprog <port> [edges|pulses|bits]");
+    Serial.println("  debounce <port> [us]");
+    Serial.println("  eof <port> [us]");
+    Serial.println("  split <port> [ticks]");
+    Serial.println("  resolution <port> [ns]");
+    Serial.println("  raw <port> [on|off]");
+    Serial.println("  trig <port> [pattern <hex> <bits>|pulse <min_us> <max_us>|bits <n>] [post] | read | off");
+    Serial.println("  hist <port> [clear]");
+    Serial.println("  comply <port> [on|off|clear|pulse <min_us> <max_us>|gap <min_us> <max_us>|overlap <allow|forbid>]");
+    Serial.println("  timebase [sync]");
+    Serial.println("  stats");
+    Serial.println("  pool");
+    Serial.println("  cpu");
+    Serial.println("  bench [bits] [pulse_us]");
     Serial.println("  qrcode <text>");
     Serial.println("  barcode <text>");
     Serial.println("  terminal");
@@ -81,14 +186,10 @@ bool cmd_help(int argc, char *argv[])
 
 bool cmd_pins(int argc, char *argv[])
 {
-    if (argc < 2) { Serial.println("ERR usage: pins <a|b|c>"); return false; }
+    if (argc < 2) { Serial.println("ERR usage: pins <port>"); return false; }
     const char port_char = argv[1][0];
-    int port_index = -1;
-    if (port_char == 'a') port_index = 0;
-    else if (port_char == 'b') port_index = 1;
-    else if (port_char == 'c') port_index = 2;
-    else { Serial.println("ERR bad port"); return false; }
-    if (!g_ports || static_cast<size_t>(port_index) >= g_port_count) { Serial.println("ERR bad port"); return false; }
+    const int port_index = port_index_from_arg(argv[1]);
+    if (port_index < 0) { Serial.println("ERR bad port"); return false; }
     const uint d0_pin = g_ports[port_index].rx_pin_d0();
     const uint d1_pin = g_ports[port_index].rx_pin_d1();
     const int d0 = digitalRead(d0_pin);
@@ -98,6 +199,25 @@ bool cmd_pins(int argc, char *argv[])
     return true;
 }
 
+// RxMessage::errors bit i, i < WiegandDecoder::kErrorKinds.
+const char *frame_error_name(uint32_t bit)
+{
+    static const char *const kNames[WiegandDecoder::kErrorKinds] = {"overlap", "runt", "truncated", "line_low"};
+    return (bit < WiegandDecoder::kErrorKinds) ? kNames[bit] : "?";
+}
+
+// [[min,avg,max],...]
+void print_timing_list(const TimingSummary *list, size_t count)
+{
+    Serial.print("[");
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (i > 0) Serial.print(",");
+        Serial.print("["); Serial.print(list[i].min); Serial.print(","); Serial.print(list[i].avg); Serial.print(","); Serial.print(list[i].max); Serial.print("]");
+    }
+    Serial.print("]");
+}
+
 bool cmd_getrx(int argc, char *argv[])
 {
     (void)argc; (void)argv;
@@ -112,11 +232,52 @@ bool cmd_getrx(int argc, char *argv[])
         if (i > 0) Serial.print(",");
         Serial.print("{\"port\":\""); Serial.print(static_cast<char>('a' + m.port_id));
         Serial.print("\",\"bits\":"); Serial.print(m.bit_count);
-        Serial.print(",\"pulse\":["); Serial.print(m.pulse_min); Serial.print(","); Serial.print(m.pulse_avg); Serial.print(","); Serial.print(m.pulse_max);
-        Serial.print("],\"gap\":["); Serial.print(m.inter_min); Serial.print(","); Serial.print(m.inter_avg); Serial.print(","); Serial.print(m.inter_max);
-        Serial.print("],\"data\":\"");
-        char hexline[2 * sizeof(m.data) + 3] = {};
-        if (bitutils_format_hex_msb(m.data, m.bit_count, hexline, sizeof(hexline)))
+        Serial.print(",\"pulse\":["); Serial.print(m.pulse_min / 1000); Serial.print(","); Serial.print(m.pulse_avg / 1000); Serial.print(","); Serial.print(m.pulse_max / 1000);
+        Serial.print("],\"gap\":["); Serial.print(m.inter_min / 1000); Serial.print(","); Serial.print(m.inter_avg / 1000); Serial.print(","); Serial.print(m.inter_max / 1000);
+        Serial.print("],\"pulse_ns\":["); Serial.print(m.pulse_min); Serial.print(","); Serial.print(m.pulse_avg); Serial.print(","); Serial.print(m.pulse_max);
+        Serial.print("],\"gap_ns\":["); Serial.print(m.inter_min); Serial.print(","); Serial.print(m.inter_avg); Serial.print(","); Serial.print(m.inter_max);
+        Serial.print("],\"pulse_line_ns\":"); print_timing_list(m.pulse_line, 2);
+        Serial.print(",\"gap_bits_ns\":"); print_timing_list(m.gap_bits, 4);
+        Serial.print(",\"start_us\":"); Serial.print(m.start_us);
+        Serial.print(",\"end_us\":"); Serial.print(m.end_us);
+        Serial.print(",\"start_tick\":"); Serial.print(m.start_tick);
+        Serial.print(",\"end_tick\":"); Serial.print(m.end_tick);
+        Serial.print(",\"format\":\""); Serial.print(wiegand_format_name(m.format)); Serial.print("\"");
+        if (m.format != kWiegandFormatRaw)
+        {
+            Serial.print(",\"fc\":"); Serial.print(m.facility);
+            Serial.print(",\"card\":"); Serial.print(m.card);
+            Serial.print(",\"parity\":"); Serial.print(m.parity_errors == 0 ? 1 : 0);
+            Serial.print(",\"parity_errors\":"); Serial.print(m.parity_errors);
+            if (m.inverted) Serial.print(",\"swapped\":1");
+        }
+        if (m.errors != 0)
+        {
+            Serial.print(",\"errors\":[");
+            bool first = true;
+            for (uint32_t b = 0; b < WiegandDecoder::kErrorKinds; ++b)
+            {
+                if ((m.errors & (1u << b)) == 0) continue;
+                if (!first) Serial.print(",");
+                Serial.print("\""); Serial.print(frame_error_name(b)); Serial.print("\"");
+                first = false;
+            }
+            Serial.print("]");
+        }
+        if (m.checked)
+        {
+            Serial.print(",\"verdict\":\""); Serial.print(m.compliant ? "pass" : "fail");
+            Serial.print("\",\"violations\":[");
+            for (uint32_t r = 0; r < kComplianceRules; ++r)
+            {
+                if (r > 0) Serial.print(",");
+                Serial.print(m.violations[r]);
+            }
+            Serial.print("]");
+        }
+        Serial.print(",\"data\":\"");
+        char hexline[2 * kWiegandMaxFrameBytes + 3] = {};
+        if (bitutils_format_hex_msb(m.bits(), m.bit_count, hexline, sizeof(hexline)))
         {
             Serial.print(hexline);
         }
@@ -130,13 +291,12 @@ bool cmd_getrx(int argc, char *argv[])
 
 bool cmd_tx(int argc, char *argv[])
 {
-    if (argc < 3) { Serial.println("ERR usage: tx <a|b|c> <hexdata> [bits] [bit_us] [inter_us]"); return false; }
+    if (argc < 3) { Serial.println("ERR usage: tx <port> <hexdata> [bits] [bit_us] [inter_us]"); return false; }
 
-    const char port_char = argv[1][0];
-    int port_index = (port_char == 'a') ? 0 : (port_char == 'b') ? 1 : (port_char == 'c') ? 2 : -1;
-    if (port_index < 0 || !g_ports || static_cast<size_t>(port_index) >= g_port_count) { Serial.println("ERR bad port"); return false; }
+    const int port_index = port_index_from_arg(argv[1]);
+    if (port_index < 0) { Serial.println("ERR bad port"); return false; }
 
-    constexpr size_t kMaxTxBytes = 32;
+    constexpr size_t kMaxTxBytes = kWiegandMaxFrameBytes;
     uint8_t tx_buf[kMaxTxBytes];
     std::memset(tx_buf, 0, sizeof(tx_buf)); // pad remaining bits with zeros
     size_t tx_len = 0;
@@ -149,9 +309,11 @@ bool cmd_tx(int argc, char *argv[])
         bit_count = static_cast<uint32_t>(std::strtoul(argv[3], nullptr, 10));
         if (bit_count == 0) { Serial.println("ERR bad bits"); return false; }
     }
-    if (bit_count > 256)
+    if (bit_count > kWiegandMaxFrameBits)
     {
-        Serial.println("ERR too many bits (max 256)");
+        Serial.print("ERR too many bits (max ");
+        Serial.print(kWiegandMaxFrameBits);
+        Serial.println(")");
         return false;
     }
 
@@ -173,6 +335,7 @@ bool cmd_tx(int argc, char *argv[])
         if (interbit_us == 0) interbit_us = 1;
     }
 
+    if (!g_ports[port_index].tx_allowed()) { Serial.println("ERR port not tx"); return false; }
     if (!g_ports[port_index].transmit(tx_buf, tx_len, bit_count, bit_time_us, interbit_us))
     {
         Serial.println("ERR transmit failed");
@@ -182,6 +345,539 @@ bool cmd_tx(int argc, char *argv[])
     return true;
 }
 
+bool cmd_role(int argc, char *argv[])
+{
+    if (argc < 2) { Serial.println("ERR usage: role <port> [rxtx|rx|tx|disabled]"); return false; }
+    const int port_index = port_index_from_arg(argv[1]);
+    if (port_index < 0) { Serial.println("ERR bad port"); return false; }
+    WiegandPort &port = g_ports[port_index];
+    if (argc >= 3)
+    {
+        WiegandPort::Role role;
+        if (std::strcmp(argv[2], "rxtx") == 0) role = WiegandPort::Role::RxTx;
+        else if (std::strcmp(argv[2], "rx") == 0) role = WiegandPort::Role::Rx;
+        else if (std::strcmp(argv[2], "tx") == 0) role = WiegandPort::Role::Tx;
+        else if (std::strcmp(argv[2], "disabled") == 0) role = WiegandPort::Role::Disabled;
+        else { Serial.println("ERR usage: role <port> [rxtx|rx|tx|disabled]"); return false; }
+        bool ok;
+        {
+            RxCoreLock lock;
+            ok = port.set_role(role);
+        }
+        if (!ok) { Serial.println("ERR no pio space"); return false; }
+    }
+    Serial.print("{\"port\":\""); Serial.print(argv[1][0]);
+    Serial.print("\",\"role\":\""); Serial.print(role_name(port.role()));
+    Serial.print("\",\"rx_active\":"); Serial.print(port.rx_active() ? 1 : 0);
+    Serial.println("}");
+    return true;
+}
+
+bool cmd_format(int argc, char *argv[])
+{
+    if (argc < 2) { Serial.println("ERR usage: format <port> [reset]"); return false; }
+    const int port_index = port_index_from_arg(argv[1]);
+    if (port_index < 0) { Serial.println("ERR bad port"); return false; }
+    WiegandPort &port = g_ports[port_index];
+    if (argc >= 3)
+    {
+        if (std::strcmp(argv[2], "reset") != 0) { Serial.println("ERR usage: format <port> [reset]"); return false; }
+        RxCoreLock lock;
+        port.reset_format_cache();
+    }
+    // What the port has learned: hits decoded with the cached format alone, searches went
+    // through every format.
+    const WiegandFormatCache &cache = port.format_cache();
+    Serial.print("{\"port\":\""); Serial.print(argv[1][0]);
+    Serial.print("\",\"format\":\""); Serial.print(wiegand_format_name(cache.format()));
+    Serial.print("\",\"swapped\":"); Serial.print(cache.inverted() ? 1 : 0);
+    Serial.print(",\"hits\":"); Serial.print(cache.hits());
+    Serial.print(",\"searches\":"); Serial.print(cache.searches());
+    Serial.print(",\"changes\":"); Serial.print(cache.changes());
+    Serial.println("}");
+    return true;
+}
+
+bool cmd_capture(int argc, char *argv[])
+{
+    if (argc < 2) { Serial.println("ERR usage: capture <port> [irq|dma]"); return false; }
+    const int port_index = port_index_from_arg(argv[1]);
+    if (port_index < 0) { Serial.println("ERR bad port"); return false; }
+    WiegandPort &port = g_ports[port_index];
+    if (argc >= 3)
+    {
+        WiegandPort::CaptureMode mode;
+        if (std::strcmp(argv[2], "irq") == 0) mode = WiegandPort::CaptureMode::Irq;
+        else if (std::strcmp(argv[2], "dma") == 0) mode = WiegandPort::CaptureMode::Dma;
+        else { Serial.println("ERR bad mode"); return false; }
+        bool ok;
+        {
+            RxCoreLock lock;
+            ok = port.set_capture_mode(mode);
+        }
+        if (!ok) { Serial.println("ERR no dma channel or edge blocks"); return false; }
+    }
+    Serial.print("{\"port\":\""); Serial.print(argv[1][0]);
+    Serial.print("\",\"capture\":\""); Serial.print(capture_mode_name(port.capture_mode()));
+    Serial.println("\"}");
+    return true;
+}
+
+bool cmd_rxprog(int argc, char *argv[])
+{
+    if (argc < 2) { Serial.println("ERR usage: rxprog <port> [edges|pulses|bits]"); return false; }
+    const int port_index = port_index_from_arg(argv[1]);
+    if (port_index < 0) { Serial.println("ERR bad port"); return false; }
+    WiegandPort &port = g_ports[port_index];
+    if (argc >= 3)
+    {
+        WiegandRxProgram program;
+        if (std::strcmp(argv[2], "edges") == 0) program = WiegandRxProgram::Edges;
+        else if (std::strcmp(argv[2], "pulses") == 0) program = WiegandRxProgram::Pulses;
+        else if (std::strcmp(argv[2], "bits") == 0) program = WiegandRxProgram::Bits;
+        else { Serial.println("ERR bad program"); return false; }
+        bool ok;
+        {
+            RxCoreLock lock;
+            ok = port.set_rx_program(program);
+        }
+        if (!ok) { Serial.println("ERR no pio space"); return false; }
+    }
+    Serial.print("{\"port\":\""); Serial.print(argv[1][0]);
+    Serial.print("\",\"rxprog\":\""); Serial.print(rx_program_name(port.rx_program()));
+    Serial.println("\"}");
+    return true;
+}
+
+bool cmd_debounce(int argc, char *argv[])
+{
+    if (argc < 2) { Serial.println("ERR usage: debounce <port> [us]"); return false; }
+    const int port_index = port_index_from_arg(argv[1]);
+    if (port_index < 0) { Serial.println("ERR bad port"); return false; }
+    WiegandPort &port = g_ports[port_index];
+    if (argc >= 3)
+    {
+        const uint32_t us = static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10));
+        RxCoreLock lock;
+        port.set_glitch_filter_us(us);
+    }
+    // Rounded to whole ticks and clamped, so this can differ from what was asked for.
+    Serial.print("{\"port\":\""); Serial.print(argv[1][0]);
+    Serial.print("\",\"debounce_us\":"); Serial.print(port.glitch_filter_us());
+    Serial.println("}");
+    return true;
+}
+
+bool cmd_eof(int argc, char *argv[])
+{
+    if (argc < 2) { Serial.println("ERR usage: eof <port> [us]"); return false; }
+    const int port_index = port_index_from_arg(argv[1]);
+    if (port_index < 0) { Serial.println("ERR bad port"); return false; }
+    WiegandPort &port = g_ports[port_index];
+    if (argc >= 3)
+    {
+        const uint32_t us = static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10));
+        if (us == 0) { Serial.println("ERR bad time"); return false; }
+        port.set_frame_quiet_us(us);
+    }
+    Serial.print("{\"port\":\""); Serial.print(argv[1][0]);
+    Serial.print("\",\"eof_us\":"); Serial.print(port.frame_quiet_us());
+    Serial.println("}");
+    return true;
+}
+
+bool cmd_split(int argc, char *argv[])
+{
+    if (argc < 2) { Serial.println("ERR usage: split <port> [ticks]"); return false; }
+    const int port_index = port_index_from_arg(argv[1]);
+    if (port_index < 0) { Serial.println("ERR bad port"); return false; }
+    WiegandPort &port = g_ports[port_index];
+    if (argc >= 3)
+    {
+        port.set_split_gap_ticks(static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)));
+    }
+    Serial.print("{\"port\":\""); Serial.print(argv[1][0]);
+    Serial.print("\",\"split_ticks\":"); Serial.print(port.split_gap_ticks());
+    Serial.println("}");
+    return true;
+}
+
+bool cmd_resolution(int argc, char *argv[])
+{
+    if (argc < 2) { Serial.println("ERR usage: resolution <port> [ns]"); return false; }
+    const int port_index = port_index_from_arg(argv[1]);
+    if (port_index < 0) { Serial.println("ERR bad port"); return false; }
+    WiegandPort &port = g_ports[port_index];
+    if (argc >= 3)
+    {
+        const uint32_t ns = static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10));
+        if (ns == 0) { Serial.println("ERR bad time"); return false; }
+        if (ns > WiegandPort::max_tick_ns()) { Serial.print("ERR tick too long (max "); Serial.print(WiegandPort::max_tick_ns()); Serial.println(" ns)"); return false; }
+        RxCoreLock lock;
+        port.set_tick_ns(ns);
+    }
+    // The nearest tick the divider gives; "timebase sync" puts the port back in step.
+    Serial.print("{\"port\":\""); Serial.print(argv[1][0]);
+    Serial.print("\",\"tick_ns\":"); Serial.print(port.tick_ns());
+    Serial.print(",\"clkdiv\":"); Serial.print(port.clk_div(), 3);
+    Serial.print(",\"span_ms\":"); Serial.print(port.counter_span_us() / 1000);
+    Serial.print(",\"debounce_us\":"); Serial.print(port.glitch_filter_us());
+    Serial.println("}");
+    return true;
+}
+
+bool cmd_raw(int argc, char *argv[])
+{
+    if (argc < 2) { Serial.println("ERR usage: raw <port> [on|off]"); return false; }
+    const int port_index = port_index_from_arg(argv[1]);
+    if (port_index < 0) { Serial.println("ERR bad port"); return false; }
+    WiegandPort &port = g_ports[port_index];
+    if (argc >= 3)
+    {
+        bool on;
+        if (std::strcmp(argv[2], "on") == 0) on = true;
+        else if (std::strcmp(argv[2], "off") == 0) on = false;
+        else { Serial.println("ERR usage: raw <port> [on|off]"); return false; }
+        bool ok;
+        {
+            RxCoreLock lock;
+            ok = port.set_raw_stream(on);
+        }
+        if (!ok) { Serial.println("ERR needs rxprog edges"); return false; }
+        if (on) raw_stream_start(static_cast<uint>(port_index));
+    }
+    // Counted as packets are written: the average since 'raw on' and the best full second.
+    const RawStreamStats st = raw_stream_stats(static_cast<uint>(port_index));
+    Serial.print("{\"port\":\""); Serial.print(argv[1][0]);
+    Serial.print("\",\"raw\":"); Serial.print(port.raw_stream() ? 1 : 0);
+    Serial.print(",\"packets\":"); Serial.print(st.packets);
+    Serial.print(",\"records\":"); Serial.print(st.records);
+    Serial.print(",\"lost\":"); Serial.print(st.lost);
+    Serial.print(",\"records_per_s\":"); Serial.print(st.records_per_s);
+    Serial.print(",\"peak_per_s\":"); Serial.print(st.peak_per_s);
+    Serial.println("}");
+    return true;
+}
+
+// Frozen trigger window as [ticks from the trigger record, levels] pairs.
+void print_trigger_window(char port_char, const WiegandPort &port)
+{
+    const EdgeTrigger &trig = port.trigger();
+    const uint32_t trigger_ts = trig.trigger_word() >> 2;
+    Serial.print("{\"port\":\""); Serial.print(port_char);
+    Serial.print("\",\"kind\":\""); Serial.print(trigger_kind_name(trig.condition().kind));
+    Serial.print("\",\"tick_ns\":"); Serial.print(port.tick_ns());
+    Serial.print(",\"trigger\":"); Serial.print(trig.trigger_index());
+    Serial.print(",\"edges\":[");
+    EdgeStore::Reader reader = trig.reader();
+    uint32_t word;
+    for (uint32_t i = 0; reader.next(word); ++i)
+    {
+        // The PIO counter runs down and is 30 bits wide.
+        int32_t rel = static_cast<int32_t>((trigger_ts - (word >> 2)) & 0x3FFFFFFFu);
+        if (rel >= (1 << 29)) rel -= (1 << 30);
+        if (i > 0) Serial.print(",");
+        Serial.print("["); Serial.print(static_cast<long>(rel)); Serial.print(","); Serial.print(word & 0x3); Serial.print("]");
+    }
+    Serial.println("]}");
+}
+
+bool cmd_trig(int argc, char *argv[])
+{
+    if (argc < 2) { Serial.println("ERR usage: trig <port> [pattern <hex> <bits>|pulse <min_us> <max_us>|bits <n>] [post] | read | off"); return false; }
+    const int port_index = port_index_from_arg(argv[1]);
+    if (port_index < 0) { Serial.println("ERR bad port"); return false; }
+    WiegandPort &port = g_ports[port_index];
+    if (argc >= 3 && std::strcmp(argv[2], "read") == 0)
+    {
+        if (port.trigger().state() != EdgeTrigger::State::Frozen) { Serial.println("ERR not triggered"); return false; }
+        print_trigger_window(argv[1][0], port);
+        return true;
+    }
+    if (argc >= 3 && std::strcmp(argv[2], "off") == 0)
+    {
+        RxCoreLock lock;
+        port.disarm_trigger();
+    }
+    else if (argc >= 3)
+    {
+        EdgeTrigger::Condition cond{};
+        int next = 3;
+        if (std::strcmp(argv[2], "pattern") == 0 && argc >= 5)
+        {
+            cond.kind = EdgeTrigger::Kind::Pattern;
+            cond.pattern = static_cast<uint32_t>(std::strtoul(argv[3], nullptr, 16));
+            cond.pattern_bits = static_cast<uint32_t>(std::strtoul(argv[4], nullptr, 10));
+            if (cond.pattern_bits == 0 || cond.pattern_bits > 32) { Serial.println("ERR bad bits"); return false; }
+            if (cond.pattern_bits < 32 && (cond.pattern >> cond.pattern_bits) != 0) { Serial.println("ERR pattern wider than bits"); return false; }
+            next = 5;
+        }
+        else if (std::strcmp(argv[2], "pulse") == 0 && argc >= 5)
+        {
+            cond.kind = EdgeTrigger::Kind::PulseWidth;
+            const uint32_t min_us = static_cast<uint32_t>(std::strtoul(argv[3], nullptr, 10));
+            const uint32_t max_us = static_cast<uint32_t>(std::strtoul(argv[4], nullptr, 10));
+            if (max_us < min_us || max_us > 4000000) { Serial.println("ERR bad range"); return false; }
+            cond.pulse_min = min_us * 1000;
+            cond.pulse_max = max_us * 1000;
+            next = 5;
+        }
+        else if (std::strcmp(argv[2], "bits") == 0 && argc >= 4)
+        {
+            cond.kind = EdgeTrigger::Kind::BitCount;
+            cond.bit_count = static_cast<uint32_t>(std::strtoul(argv[3], nullptr, 10));
+            next = 4;
+        }
+        else { Serial.println("ERR usage: trig <port> [pattern <hex> <bits>|pulse <min_us> <max_us>|bits <n>] [post] | read | off"); return false; }
+        const uint32_t post = (argc > next) ? static_cast<uint32_t>(std::strtoul(argv[next], nullptr, 10)) : 64;
+        bool ok;
+        {
+            RxCoreLock lock;
+            ok = port.arm_trigger(cond, post);
+        }
+        if (!ok) { Serial.println("ERR needs rxprog edges and free pool blocks"); return false; }
+    }
+    const EdgeTrigger &trig = port.trigger();
+    Serial.print("{\"port\":\""); Serial.print(argv[1][0]);
+    Serial.print("\",\"trig\":\""); Serial.print(trigger_state_name(trig.state()));
+    Serial.print("\"");
+    if (trig.state() != EdgeTrigger::State::Off)
+    {
+        Serial.print(",\"kind\":\""); Serial.print(trigger_kind_name(trig.condition().kind));
+        Serial.print("\",\"post\":"); Serial.print(trig.post());
+        Serial.print(",\"stored\":"); Serial.print(trig.size());
+    }
+    Serial.println("}");
+    return true;
+}
+
+// Non-empty span of a histogram as {"from":first bin,"counts":[...]}.
+void print_histogram(const TimingHistogram &hist)
+{
+    uint32_t first = 0;
+    uint32_t end = TimingHistogram::kBins;
+    while (first < end && hist.counts[first] == 0) ++first;
+    while (end > first && hist.counts[end - 1] == 0) --end;
+    Serial.print("{\"from\":"); Serial.print(first);
+    Serial.print(",\"counts\":[");
+    for (uint32_t b = first; b < end; ++b)
+    {
+        if (b > first) Serial.print(",");
+        Serial.print(hist.counts[b]);
+    }
+    Serial.print("]}");
+}
+
+bool cmd_hist(int argc, char *argv[])
+{
+    if (argc < 2) { Serial.println("ERR usage: hist <port> [clear]"); return false; }
+    const int port_index = port_index_from_arg(argv[1]);
+    if (port_index < 0) { Serial.println("ERR bad port"); return false; }
+    WiegandPort &port = g_ports[port_index];
+    if (argc >= 3)
+    {
+        if (std::strcmp(argv[2], "clear") != 0) { Serial.println("ERR usage: hist <port> [clear]"); return false; }
+        RxCoreLock lock;
+        port.clear_histograms();
+    }
+    // Bins are log-spaced in ticks of tick_ns, two per octave (see TimingHistogram).
+    Serial.print("{\"port\":\""); Serial.print(argv[1][0]);
+    Serial.print("\",\"tick_ns\":"); Serial.print(port.tick_ns());
+    Serial.print(",\"pulse\":["); print_histogram(port.pulse_histogram(0));
+    Serial.print(","); print_histogram(port.pulse_histogram(1));
+    Serial.print("],\"gap\":["); print_histogram(port.gap_histogram(0));
+    Serial.print(","); print_histogram(port.gap_histogram(1));
+    Serial.println("]}");
+    return true;
+}
+
+bool cmd_comply(int argc, char *argv[])
+{
+    if (argc < 2) { Serial.println("ERR usage: comply <port> [on|off|clear|pulse <min_us> <max_us>|gap <min_us> <max_us>|overlap <allow|forbid>]"); return false; }
+    const int port_index = port_index_from_arg(argv[1]);
+    if (port_index < 0) { Serial.println("ERR bad port"); return false; }
+    WiegandPort &port = g_ports[port_index];
+    if (argc >= 3)
+    {
+        ComplianceLimits limits = port.compliance();
+        if (std::strcmp(argv[2], "on") == 0) limits.enabled = true;
+        else if (std::strcmp(argv[2], "off") == 0) limits.enabled = false;
+        else if (std::strcmp(argv[2], "clear") == 0) { RxCoreLock lock; port.clear_compliance_totals(); }
+        else if ((std::strcmp(argv[2], "pulse") == 0 || std::strcmp(argv[2], "gap") == 0) && argc >= 5)
+        {
+            const uint32_t min_us = static_cast<uint32_t>(std::strtoul(argv[3], nullptr, 10));
+            const uint32_t max_us = static_cast<uint32_t>(std::strtoul(argv[4], nullptr, 10));
+            if (max_us < min_us || max_us > 4000000) { Serial.println("ERR bad range"); return false; }
+            if (argv[2][0] == 'p') { limits.pulse_min = min_us * 1000; limits.pulse_max = max_us * 1000; }
+            else { limits.gap_min = min_us * 1000; limits.gap_max = max_us * 1000; }
+        }
+        else if (std::strcmp(argv[2], "overlap") == 0 && argc >= 4 && (std::strcmp(argv[3], "allow") == 0 || std::strcmp(argv[3], "forbid") == 0))
+        {
+            limits.allow_overlap = std::strcmp(argv[3], "allow") == 0;
+        }
+        else { Serial.println("ERR usage: comply <port> [on|off|clear|pulse <min_us> <max_us>|gap <min_us> <max_us>|overlap <allow|forbid>]"); return false; }
+        RxCoreLock lock;
+        port.set_compliance(limits);
+    }
+    // Limits in us, then frames checked and failed and each rule's breaches since 'clear'.
+    const ComplianceLimits &limits = port.compliance();
+    const WiegandPort::ComplianceTotals totals = port.compliance_totals();
+    Serial.print("{\"port\":\""); Serial.print(argv[1][0]);
+    Serial.print("\",\"on\":"); Serial.print(limits.enabled ? 1 : 0);
+    Serial.print(",\"pulse_us\":["); Serial.print(limits.pulse_min / 1000); Serial.print(","); Serial.print(limits.pulse_max / 1000);
+    Serial.print("],\"gap_us\":["); Serial.print(limits.gap_min / 1000); Serial.print(","); Serial.print(limits.gap_max / 1000);
+    Serial.print("],\"allow_overlap\":"); Serial.print(limits.allow_overlap ? 1 : 0);
+    Serial.print(",\"frames\":"); Serial.print(totals.frames);
+    Serial.print(",\"failed\":"); Serial.print(totals.failed);
+    for (uint32_t r = 0; r < kComplianceRules; ++r)
+    {
+        Serial.print(",\""); Serial.print(compliance_rule_name(r)); Serial.print("\":"); Serial.print(totals.violations[r]);
+    }
+    Serial.println("}");
+    return true;
+}
+
+bool cmd_timebase(int argc, char *argv[])
+{
+    if (argc >= 2)
+    {
+        if (std::strcmp(argv[1], "sync") != 0) { Serial.println("ERR usage: timebase [sync]"); return false; }
+        RxCoreLock lock;
+        WiegandPort::sync_rx_timebase(g_ports, g_port_count);
+    }
+    // Ports whose start/end ticks can be compared directly.
+    Serial.print("{\"synced\":\"");
+    for (size_t i = 0; i < g_port_count; ++i)
+    {
+        if (g_ports[i].timebase_synced()) Serial.print(static_cast<char>('a' + i));
+    }
+    Serial.println("\"}");
+    return true;
+}
+
+bool cmd_stats(int argc, char *argv[])
+{
+    (void)argc; (void)argv;
+    Serial.print("[");
+    for (size_t i = 0; i < g_port_count; ++i)
+    {
+        const WiegandPort::CaptureStats st = g_ports[i].capture_stats();
+        if (i > 0) Serial.print(",");
+        Serial.print("{\"port\":\""); Serial.print(static_cast<char>('a' + i));
+        Serial.print("\",\"role\":\""); Serial.print(role_name(g_ports[i].role()));
+        Serial.print("\",\"capture\":\""); Serial.print(capture_mode_name(st.mode));
+        Serial.print("\",\"rxprog\":\""); Serial.print(rx_program_name(g_ports[i].rx_program()));
+        Serial.print("\",\"irqs\":"); Serial.print(st.irqs);
+        Serial.print(",\"irq_edges\":"); Serial.print(st.irq_edges);
+        Serial.print(",\"dma_edges\":"); Serial.print(st.dma_edges);
+        Serial.print(",\"dropped\":"); Serial.print(st.dropped);
+        Serial.print(",\"glitches\":"); Serial.print(st.glitches);
+        Serial.print(",\"blocks\":"); Serial.print(st.blocks);
+        Serial.print(",\"blocks_peak\":"); Serial.print(st.blocks_peak);
+        Serial.print(",\"records_peak\":"); Serial.print(st.records_peak);
+        Serial.print(",\"alloc_failures\":"); Serial.print(st.alloc_failures);
+        // Frames with each fault, and stuck-line episodes (stuck_lines: bit 0 D0, bit 1 D1 now).
+        const WiegandPort::ErrorCounts err = g_ports[i].error_counts();
+        Serial.print(",\"errors\":{\"overlap\":"); Serial.print(err.overlap);
+        Serial.print(",\"runt\":"); Serial.print(err.runt);
+        Serial.print(",\"truncated\":"); Serial.print(err.truncated);
+        Serial.print(",\"line_low\":"); Serial.print(err.line_low);
+        Serial.print(",\"stuck\":"); Serial.print(err.stuck);
+        Serial.print("},\"stuck_lines\":"); Serial.print(g_ports[i].stuck_lines());
+        Serial.print("}");
+    }
+    Serial.println("]");
+    return true;
+}
+
+bool cmd_pool(int argc, char *argv[])
+{
+    (void)argc; (void)argv;
+    // The edge-record blocks all ports borrow from.
+    Serial.print("{\"blocks\":"); Serial.print(EdgePool::kBlocks);
+    Serial.print(",\"block_words\":"); Serial.print(EdgePool::kBlockWords);
+    Serial.print(",\"free\":"); Serial.print(g_edge_pool.free_blocks());
+    Serial.print(",\"peak_used\":"); Serial.print(g_edge_pool.peak_used());
+    Serial.print(",\"alloc_failures\":"); Serial.print(g_edge_pool.alloc_failures());
+    // Buffers for received frames longer than a log entry holds (see wiegand_frame.h).
+    Serial.print(",\"long_frames\":{\"max_bits\":"); Serial.print(kWiegandMaxFrameBits);
+    Serial.print(",\"slots\":"); Serial.print(LongFrameStore::kSlots);
+    Serial.print(",\"free\":"); Serial.print(g_long_frames.free_slots());
+    Serial.print(",\"alloc_failures\":"); Serial.print(g_long_frames.alloc_failures());
+    Serial.println("}}");
+    return true;
+}
+
+bool cmd_cpu(int argc, char *argv[])
+{
+    (void)argc; (void)argv;
+    // Busy and ISR share of each core since the previous 'cpu' command.
+    Serial.print("{\"dual_core\":"); Serial.print(WIEGAND_DUAL_CORE ? 1 : 0);
+    Serial.print(",\"cores\":[");
+    for (uint core = 0; core < 2; ++core)
+    {
+        const CoreLoadCounters now = core_load_read(core);
+        const CoreLoadCounters &prev = g_cpu_prev[core];
+        const uint32_t window = now.now_us - prev.now_us;
+        const uint32_t idle = now.idle_us - prev.idle_us;
+        const uint32_t isr = now.isr_us - prev.isr_us;
+        const float busy_pct =
+            (window > 0 && window >= idle) ? 100.0f * (window - idle) / window : 0.0f;
+        const float isr_pct = (window > 0) ? 100.0f * isr / window : 0.0f;
+        g_cpu_prev[core] = now;
+        if (core > 0) Serial.print(",");
+        Serial.print("{\"core\":"); Serial.print(core);
+        Serial.print(",\"window_ms\":"); Serial.print(window / 1000);
+        Serial.print(",\"busy_pct\":"); Serial.print(busy_pct, 1);
+        Serial.print(",\"isr_pct\":"); Serial.print(isr_pct, 1);
+        Serial.print("}");
+    }
+    Serial.print("],\"rx_queue_dropped\":"); Serial.print(g_rx_queue.dropped());
+    Serial.println("}");
+    return true;
+}
+
+void print_bench_result(const RxBenchResult &r)
+{
+    Serial.print("{\"pulse_us\":"); Serial.print(r.pulse_us);
+    Serial.print(",\"ports\":"); Serial.print(r.ports);
+    Serial.print(",\"edges\":"); Serial.print(r.edges_sent);
+    Serial.print(",\"expected\":"); Serial.print(r.records_expected);
+    Serial.print(",\"received\":"); Serial.print(r.records_received);
+    Serial.print(",\"dropped\":"); Serial.print(r.dropped);
+    Serial.print(",\"stalled\":"); Serial.print(r.stalled);
+    Serial.print(",\"us\":"); Serial.print(r.elapsed_us);
+    Serial.print(",\"edges_per_s\":"); Serial.print(r.edges_per_s);
+    Serial.println("}");
+}
+
+bool cmd_bench(int argc, char *argv[])
+{
+    // With a pulse width: one run. Without: halve the pulse from 64 us until the first run
+    // that loses records, and report the best aggregate rate every port kept up with.
+    uint32_t bits = 128;
+    if (argc >= 2) bits = static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10));
+    if (bits == 0 || bits > kWiegandMaxFrameBits) { Serial.print("ERR bits 1.."); Serial.println(kWiegandMaxFrameBits); return false; }
+    if (argc >= 3)
+    {
+        const uint32_t pulse_us = static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10));
+        if (pulse_us == 0) { Serial.println("ERR bad pulse"); return false; }
+        print_bench_result(rx_bench_run(g_ports, g_port_count, bits, pulse_us));
+        return true;
+    }
+    uint32_t best = 0;
+    for (uint32_t pulse_us = 64; pulse_us >= 1; pulse_us /= 2)
+    {
+        const RxBenchResult r = rx_bench_run(g_ports, g_port_count, bits, pulse_us);
+        print_bench_result(r);
+        if (!r.lossless()) break;
+        best = r.edges_per_s;
+    }
+    Serial.print("{\"max_edges_per_s\":"); Serial.print(best);
+    Serial.println("}");
+    return true;
+}
+
 bool cmd_qrcode(int argc, char *argv[])
 {
     if (argc < 2) { Serial.println("ERR usage: qrcode <text>"); return false; }
@@ -253,6 +949,23 @@ SerialCommand kCommands[] = {
     {"pins",  cmd_pins},
     {"getrx", cmd_getrx},
     {"tx",    cmd_tx},
+    {"role",  cmd_role},
+    {"format", cmd_format},
+    {"capture", cmd_capture},
+    {"rxprog",  cmd_rxprog},
+    {"debounce", cmd_debounce},
+    {"eof",   cmd_eof},
+    {"split", cmd_split},
+    {"resolution", cmd_resolution},
+    {"raw",   cmd_raw},
+    {"trig",  cmd_trig},
+    {"hist",  cmd_hist},
+    {"comply", cmd_comply},
+    {"timebase", cmd_timebase},
+    {"stats", cmd_stats},
+    {"pool",  cmd_pool},
+    {"cpu",   cmd_cpu},
+    {"bench", cmd_bench},
     {"qrcode", cmd_qrcode},
     {"barcode", cmd_barcode},
     {"terminal", cmd_terminal},
@@ -5,6 +5,8 @@
 #include "serial_commands.h"
 #include "wiegand_port.h"
 
-// Register all serial commands (ping, ver, help, pins, getrx, tx).
+// Register all serial commands (ping, ver, help, pins, getrx, tx, role, format, capture, rxprog,
+// debounce, eof, split, resolution, raw, trig, hist, comply, timebase, stats, pool, cpu, bench,
+// ...).
 // ports points to an array of WiegandPort instances (port_count entries).
 void register_commands(SerialCommandProcessor &processor, WiegandPort *ports, size_t port_count);
@@ -0,0 +1,54 @@
+#include "core_load.h"
+
+#include <hardware/timer.h>
+#include <pico/platform.h>
+
+namespace {
+
+struct CoreLoadState
+{
+    volatile uint32_t idle_us;
+    volatile uint32_t isr_us;
+    uint32_t isr_us_at_idle_begin;
+};
+
+// Each entry is only written by its own core.
+CoreLoadState g_core_load[2] = {};
+
+} // namespace
+
+uint32_t core_load_idle_begin()
+{
+    CoreLoadState &st = g_core_load[get_core_num()];
+    st.isr_us_at_idle_begin = st.isr_us;
+    return time_us_32();
+}
+
+void core_load_idle_end(uint32_t start_us)
+{
+    CoreLoadState &st = g_core_load[get_core_num()];
+    const uint32_t span = time_us_32() - start_us;
+    const uint32_t isr_during = st.isr_us - st.isr_us_at_idle_begin;
+    st.idle_us = st.idle_us + ((span > isr_during) ? (span - isr_during) : 0);
+}
+
+uint32_t core_load_isr_begin()
+{
+    return time_us_32();
+}
+
+void core_load_isr_end(uint32_t start_us)
+{
+    CoreLoadState &st = g_core_load[get_core_num()];
+    st.isr_us = st.isr_us + (time_us_32() - start_us);
+}
+
+CoreLoadCounters core_load_read(uint core)
+{
+    const CoreLoadState &st = g_core_load[core & 1];
+    CoreLoadCounters out;
+    out.now_us = time_us_32();
+    out.idle_us = st.idle_us;
+    out.isr_us = st.isr_us;
+    return out;
+}
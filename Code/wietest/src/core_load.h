@@ -0,0 +1,23 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Per-core busy-time accounting. Each core's loop brackets its idle wait with
+// core_load_idle_begin()/core_load_idle_end(), and instrumented interrupt handlers
+// bracket themselves with core_load_isr_begin()/core_load_isr_end(). Everything that is
+// not idle counts as busy; interrupts that are not instrumented (USB, TX timers) are
+// charged to whatever they interrupted.
+struct CoreLoadCounters
+{
+    uint32_t now_us;  // time_us_32() when the counters were read
+    uint32_t idle_us; // cumulative idle time, excluding instrumented ISRs taken while idle
+    uint32_t isr_us;  // cumulative time in instrumented ISRs
+};
+
+uint32_t core_load_idle_begin();
+void core_load_idle_end(uint32_t start_us);
+uint32_t core_load_isr_begin();
+void core_load_isr_end(uint32_t start_us);
+
+// Cumulative counters for core 0 or 1; callers diff two reads to get a window.
+CoreLoadCounters core_load_read(uint core);
@@ -0,0 +1,46 @@
+#include "edge_pool.h"
+
+#include <hardware/sync.h>
+
+EdgePool g_edge_pool;
+
+EdgePool::EdgePool()
+    : storage_{}, free_list_{}, free_count_(kBlocks), peak_used_(0), alloc_failures_(0)
+{
+    for (uint32_t i = 0; i < kBlocks; ++i)
+    {
+        free_list_[i] = static_cast<uint8_t>(kBlocks - 1 - i); // block 0 on top
+    }
+}
+
+volatile uint32_t *EdgePool::alloc()
+{
+    const uint32_t irq_state = save_and_disable_interrupts();
+    if (free_count_ == 0)
+    {
+        alloc_failures_ = alloc_failures_ + 1;
+        restore_interrupts(irq_state);
+        return nullptr;
+    }
+    free_count_ = free_count_ - 1;
+    volatile uint32_t *block = storage_[free_list_[free_count_]];
+    if (kBlocks - free_count_ > peak_used_)
+    {
+        peak_used_ = kBlocks - free_count_;
+    }
+    restore_interrupts(irq_state);
+    return block;
+}
+
+void EdgePool::free(volatile uint32_t *block)
+{
+    if (block == nullptr)
+    {
+        return;
+    }
+    const uint32_t index = static_cast<uint32_t>((block - storage_[0]) / kBlockWords);
+    const uint32_t irq_state = save_and_disable_interrupts();
+    free_list_[free_count_] = static_cast<uint8_t>(index);
+    free_count_ = free_count_ + 1;
+    restore_interrupts(irq_state);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Build with -D WIEGAND_EDGE_POOL_BLOCKS=n to size the shared edge pool (kBlockWords records
+// per block). The default matches the three on-board ports' old 1024-record buffers.
+#ifndef WIEGAND_EDGE_POOL_BLOCKS
+#define WIEGAND_EDGE_POOL_BLOCKS 48
+#endif
+
+// Fixed-size blocks of edge-record memory shared by every port (no allocation: the blocks are
+// static). A port borrows blocks while it has records the decoder has not consumed and hands
+// them back as soon as it has, so idle ports hold nothing and a busy port can use far more
+// than its share. Only the RX core touches the pool (its capture interrupts and process()),
+// and serial commands only while that core is parked, so masking interrupts is enough.
+class EdgePool
+{
+public:
+    static constexpr uint32_t kBlockWords = 64;
+    static constexpr uint32_t kBlocks = WIEGAND_EDGE_POOL_BLOCKS;
+    static_assert((kBlockWords & (kBlockWords - 1)) == 0, "record index uses a mask");
+    static_assert(kBlocks > 0 && kBlocks <= 255, "free list holds 8-bit block numbers");
+
+    EdgePool();
+
+    // nullptr (and a failure counted) when every block is out.
+    volatile uint32_t *alloc();
+    void free(volatile uint32_t *block);
+
+    uint32_t free_blocks() const
+    {
+        return free_count_;
+    }
+
+    // Most blocks out at once since boot.
+    uint32_t peak_used() const
+    {
+        return peak_used_;
+    }
+
+    uint32_t alloc_failures() const
+    {
+        return alloc_failures_;
+    }
+
+private:
+    volatile uint32_t storage_[kBlocks][kBlockWords];
+    uint8_t free_list_[kBlocks]; // stack of free block numbers, top at free_count_ - 1
+    volatile uint32_t free_count_;
+    volatile uint32_t peak_used_;
+    volatile uint32_t alloc_failures_;
+};
+
+extern EdgePool g_edge_pool;
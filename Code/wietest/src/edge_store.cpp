@@ -0,0 +1,170 @@
+#include "edge_store.h"
+
+namespace {
+
+uint32_t zigzag(int32_t value)
+{
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+int32_t unzigzag(uint32_t value)
+{
+    return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+} // namespace
+
+EdgeStore::EdgeStore()
+    : blocks_(nullptr),
+      block_count_(0),
+      block_bytes_(0),
+      oldest_(0),
+      used_(0),
+      write_pos_(0),
+      first_index_(0),
+      appended_(0),
+      keep_(0),
+      keep_set_(false),
+      last_word_(0),
+      history_{}
+{
+}
+
+void EdgeStore::attach(uint8_t *const *blocks, uint32_t block_count, uint32_t block_bytes)
+{
+    blocks_ = blocks;
+    block_count_ = block_count;
+    block_bytes_ = block_bytes;
+    clear();
+}
+
+void EdgeStore::clear()
+{
+    oldest_ = 0;
+    used_ = 0;
+    write_pos_ = 0;
+    first_index_ = 0;
+    appended_ = 0;
+    keep_set_ = false;
+}
+
+bool EdgeStore::start_block(uint32_t word)
+{
+    if (block_count_ == 0)
+    {
+        return false;
+    }
+    if (used_ == block_count_)
+    {
+        const uint32_t dropped = block_records(block(0));
+        if (keep_set_ && keep_ - first_index_ < dropped)
+        {
+            return false;
+        }
+        first_index_ += dropped;
+        oldest_ = (oldest_ + 1) % block_count_;
+        used_ -= 1;
+    }
+    used_ += 1;
+    uint8_t *b = block(used_ - 1);
+    b[0] = 1;
+    b[1] = 0;
+    b[2] = static_cast<uint8_t>(word);
+    b[3] = static_cast<uint8_t>(word >> 8);
+    b[4] = static_cast<uint8_t>(word >> 16);
+    b[5] = static_cast<uint8_t>(word >> 24);
+    write_pos_ = kHeaderBytes;
+    history_[0] = 0;
+    history_[1] = 0;
+    last_word_ = word;
+    appended_ += 1;
+    return true;
+}
+
+bool EdgeStore::append(uint32_t word)
+{
+    if (used_ == 0 || block_records(block(used_ - 1)) == 0xFFFF)
+    {
+        return start_block(word);
+    }
+    const uint32_t delta = ((last_word_ >> 2) - (word >> 2)) & kTimestampMask; // counts down
+    const uint32_t code = (word ^ last_word_) & 0x3;
+    uint64_t value = (static_cast<uint64_t>(zigzag(static_cast<int32_t>(delta - history_[1])))
+                      << 2) | code;
+    uint8_t encoded[kMaxVarintBytes];
+    uint32_t len = 0;
+    while (value >= 0x80)
+    {
+        encoded[len++] = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    encoded[len++] = static_cast<uint8_t>(value);
+    if (write_pos_ + len > block_bytes_)
+    {
+        return start_block(word);
+    }
+    uint8_t *b = block(used_ - 1);
+    for (uint32_t i = 0; i < len; ++i)
+    {
+        b[write_pos_ + i] = encoded[i];
+    }
+    write_pos_ += len;
+    const uint32_t records = block_records(b) + 1;
+    b[0] = static_cast<uint8_t>(records);
+    b[1] = static_cast<uint8_t>(records >> 8);
+    history_[1] = history_[0];
+    history_[0] = delta;
+    last_word_ = word;
+    appended_ += 1;
+    return true;
+}
+
+EdgeStore::Reader::Reader(const EdgeStore &store)
+    : store_(store), block_(0), in_block_(0), pos_(0), word_(0), history_{}
+{
+}
+
+bool EdgeStore::Reader::next(uint32_t &word)
+{
+    while (block_ < store_.used_)
+    {
+        const uint8_t *b = store_.block(block_);
+        if (in_block_ == block_records(b))
+        {
+            block_ += 1;
+            in_block_ = 0;
+            continue;
+        }
+        if (in_block_ == 0)
+        {
+            word_ = static_cast<uint32_t>(b[2]) | (static_cast<uint32_t>(b[3]) << 8) |
+                    (static_cast<uint32_t>(b[4]) << 16) | (static_cast<uint32_t>(b[5]) << 24);
+            pos_ = kHeaderBytes;
+            history_[0] = 0;
+            history_[1] = 0;
+        }
+        else
+        {
+            uint64_t value = 0;
+            uint32_t shift = 0;
+            uint8_t byte;
+            do
+            {
+                byte = b[pos_++];
+                value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+                shift += 7;
+            } while (byte & 0x80);
+            const uint32_t delta =
+                (history_[1] + static_cast<uint32_t>(unzigzag(static_cast<uint32_t>(value >> 2)))) &
+                kTimestampMask;
+            const uint32_t ts = ((word_ >> 2) - delta) & kTimestampMask;
+            word_ = (ts << 2) | ((word_ ^ static_cast<uint32_t>(value)) & 0x3);
+            history_[1] = history_[0];
+            history_[0] = delta;
+        }
+        in_block_ += 1;
+        word = word_;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Compressed wiegand_rx2 records ((timestamp << 2) | levels) in a ring of byte blocks. Each
+// record is a varint of (zigzag(delta - delta two records back) << 2 | levels ^ previous
+// levels), where delta is the ticks since the previous record: a fall is predicted from the
+// previous fall-to-fall spacing and a rise likewise, so a steady Wiegand train costs about one
+// byte per edge instead of four, and frame gaps a few. Lossless for any word sequence.
+//
+// Block layout: record count (u16), the block's first record in full (u32), then the rest
+// encoded against it, so the oldest block can be dropped whole when the ring wraps. Decoding
+// is sequential, oldest first, with a Reader.
+class EdgeStore
+{
+public:
+    EdgeStore();
+
+    // Use blocks (block_count of block_bytes each, in ring order) and clear. block_count = 0
+    // leaves the store empty and unusable until the next attach().
+    void attach(uint8_t *const *blocks, uint32_t block_count, uint32_t block_bytes);
+    void clear();
+
+    // Add a record, dropping the oldest block if the ring is full. Returns false (and stores
+    // nothing) if that would drop the record numbered keep or no blocks are attached.
+    bool append(uint32_t word);
+
+    // Protect record number index (see first_index()) from being dropped; clear_keep() undoes.
+    void keep(uint32_t index)
+    {
+        keep_ = index;
+        keep_set_ = true;
+    }
+
+    void clear_keep()
+    {
+        keep_set_ = false;
+    }
+
+    // Records held, and the number of the oldest (records are numbered from 0 since clear()).
+    uint32_t size() const
+    {
+        return appended_ - first_index_;
+    }
+
+    uint32_t first_index() const
+    {
+        return first_index_;
+    }
+
+    uint32_t appended() const
+    {
+        return appended_;
+    }
+
+    // The newest record (valid once appended() > 0).
+    uint32_t last_word() const
+    {
+        return last_word_;
+    }
+
+    class Reader
+    {
+    public:
+        explicit Reader(const EdgeStore &store);
+        // Next record, oldest first; false at the end.
+        bool next(uint32_t &word);
+
+    private:
+        const EdgeStore &store_;
+        uint32_t block_;      // blocks from the oldest
+        uint32_t in_block_;   // records read from the current block
+        uint32_t pos_;        // byte offset in the current block
+        uint32_t word_;
+        uint32_t history_[2]; // the last two deltas, newest first
+    };
+
+    Reader reader() const
+    {
+        return Reader(*this);
+    }
+
+private:
+    static constexpr uint32_t kHeaderBytes = 6;
+    static constexpr uint32_t kMaxVarintBytes = 5; // 33-bit values
+    static constexpr uint32_t kTimestampMask = (1u << 30) - 1;
+
+    uint8_t *block(uint32_t from_oldest) const
+    {
+        return blocks_[(oldest_ + from_oldest) % block_count_];
+    }
+
+    static uint32_t block_records(const uint8_t *b)
+    {
+        return static_cast<uint32_t>(b[0]) | (static_cast<uint32_t>(b[1]) << 8);
+    }
+
+    bool start_block(uint32_t word);
+
+    uint8_t *const *blocks_;
+    uint32_t block_count_;
+    uint32_t block_bytes_;
+    uint32_t oldest_;    // ring index of the oldest block
+    uint32_t used_;      // blocks in use, the newest being written
+    uint32_t write_pos_; // byte offset in the newest block
+    uint32_t first_index_;
+    uint32_t appended_;
+    uint32_t keep_;
+    bool keep_set_;
+    uint32_t last_word_;
+    uint32_t history_[2];
+};
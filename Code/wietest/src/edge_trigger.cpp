@@ -0,0 +1,120 @@
+#include "edge_trigger.h"
+
+EdgeTrigger::EdgeTrigger()
+    : blocks_{},
+      bytes_{},
+      store_(),
+      cond_{},
+      post_(0),
+      trigger_seq_(0),
+      trigger_word_(0),
+      last_bits_(0),
+      state_(State::Off)
+{
+}
+
+bool EdgeTrigger::arm(const Condition &cond, uint32_t post)
+{
+    if (blocks_[0] == nullptr)
+    {
+        if (g_edge_pool.free_blocks() < kBlocks)
+        {
+            return false;
+        }
+        for (uint32_t i = 0; i < kBlocks; ++i)
+        {
+            blocks_[i] = g_edge_pool.alloc();
+            // Only the RX core writes, and only a frozen window is read.
+            bytes_[i] = reinterpret_cast<uint8_t *>(const_cast<uint32_t *>(blocks_[i]));
+        }
+    }
+    store_.attach(bytes_, kBlocks, kBlockBytes);
+    cond_ = cond;
+    post_ = (post < kMaxPost) ? post : kMaxPost;
+    trigger_seq_ = 0;
+    trigger_word_ = 0;
+    last_bits_ = 0;
+    state_ = State::Armed;
+    return true;
+}
+
+void EdgeTrigger::disarm()
+{
+    state_ = State::Off;
+    store_.attach(nullptr, 0, 0);
+    for (uint32_t i = 0; i < kBlocks; ++i)
+    {
+        g_edge_pool.free(blocks_[i]);
+        blocks_[i] = nullptr;
+        bytes_[i] = nullptr;
+    }
+}
+
+void EdgeTrigger::store(uint32_t word, const WiegandDecoder &decoder)
+{
+    if (!store_.append(word))
+    {
+        state_ = State::Frozen; // the ring is full back to the trigger record
+        return;
+    }
+    if (state_ == State::Armed)
+    {
+        // Every completed pulse adds one bit, so a changed count means one just ended.
+        const uint32_t bits = decoder.bit_count();
+        if (bits != last_bits_)
+        {
+            last_bits_ = bits;
+            bool hit = false;
+            switch (cond_.kind)
+            {
+            case Kind::Pattern:
+            {
+                const uint32_t mask =
+                    (cond_.pattern_bits >= 32) ? ~0u : (1u << cond_.pattern_bits) - 1;
+                hit = bits >= cond_.pattern_bits &&
+                      (decoder.recent_bits() & mask) == cond_.pattern;
+                break;
+            }
+            case Kind::PulseWidth:
+            {
+                const uint32_t pulse = decoder.last_pulse();
+                hit = pulse < cond_.pulse_min || pulse > cond_.pulse_max;
+                break;
+            }
+            case Kind::BitCount:
+            default:
+                break; // decided in frame_end()
+            }
+            if (hit)
+            {
+                fire();
+            }
+        }
+    }
+    if (state_ == State::Filling && store_.appended() - 1 - trigger_seq_ >= post_)
+    {
+        state_ = State::Frozen;
+    }
+}
+
+void EdgeTrigger::frame_end(uint32_t bit_count)
+{
+    last_bits_ = 0; // the decoder starts the next frame from 0
+    if (state_ == State::Armed && cond_.kind == Kind::BitCount && bit_count == cond_.bit_count &&
+        store_.appended() > 0)
+    {
+        fire(); // at the frame's last record
+        if (post_ == 0)
+        {
+            state_ = State::Frozen;
+        }
+    }
+}
+
+void EdgeTrigger::fire()
+{
+    trigger_seq_ = store_.appended() - 1;
+    trigger_word_ = store_.last_word();
+    store_.keep(trigger_seq_);
+    state_ = State::Filling;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+
+#include "edge_pool.h"
+#include "edge_store.h"
+#include "wiegand_decoder.h"
+
+// Logic-analyzer style capture on one port's wiegand_rx2 records. While armed, every record
+// the decoder sees also goes into a compressed ring (EdgeStore) on blocks borrowed from
+// g_edge_pool; when the condition fires the ring keeps filling for post more records and then
+// freezes, holding the records that led up to the trigger and the ones after it until it is
+// re-armed or turned off. It also freezes early rather than drop the trigger record. Runs in
+// the port's decode pass on the RX core, with a constant cost per record.
+class EdgeTrigger
+{
+public:
+    static constexpr uint32_t kBlocks = 4;
+    static constexpr uint32_t kBlockBytes = EdgePool::kBlockWords * sizeof(uint32_t);
+    // A record takes at least a byte, so no window holds more.
+    static constexpr uint32_t kMaxPost = kBlocks * kBlockBytes;
+
+    enum class Kind
+    {
+        Pattern,    // the frame's latest pattern_bits bits equal pattern
+        PulseWidth, // a pulse shorter than pulse_min or longer than pulse_max ticks
+        BitCount,   // a frame ends with exactly bit_count bits
+    };
+
+    enum class State
+    {
+        Off,
+        Armed,   // recording, waiting for the condition
+        Filling, // fired, recording the post-trigger records
+        Frozen,  // window complete; nothing is recorded until the next arm()
+    };
+
+    struct Condition
+    {
+        Kind kind;
+        uint32_t pattern;      // right-aligned, newest bit in bit 0
+        uint32_t pattern_bits; // 1..32
+        uint32_t pulse_min;
+        uint32_t pulse_max;
+        uint32_t bit_count;
+    };
+
+    EdgeTrigger();
+
+    // Start over with a new condition, keeping post records after the trigger (at most
+    // kMaxPost). Fails if the ring's blocks cannot be borrowed.
+    bool arm(const Condition &cond, uint32_t post);
+    // Stop and give the ring back.
+    void disarm();
+
+    // RX core: a record the decoder has just been fed.
+    void record(uint32_t word, const WiegandDecoder &decoder)
+    {
+        if (state_ == State::Armed || state_ == State::Filling)
+        {
+            store(word, decoder);
+        }
+    }
+
+    // RX core: the decoder is about to publish a frame of bit_count bits.
+    void frame_end(uint32_t bit_count);
+
+    State state() const
+    {
+        return state_;
+    }
+
+    const Condition &condition() const
+    {
+        return cond_;
+    }
+
+    uint32_t post() const
+    {
+        return post_;
+    }
+
+    // The window: size() records, read oldest first with reader(), the trigger record
+    // (trigger_word()) being number trigger_index(). Only stable once frozen.
+    uint32_t size() const
+    {
+        return store_.size();
+    }
+
+    EdgeStore::Reader reader() const
+    {
+        return store_.reader();
+    }
+
+    uint32_t trigger_index() const
+    {
+        return trigger_seq_ - store_.first_index();
+    }
+
+    uint32_t trigger_word() const
+    {
+        return trigger_word_;
+    }
+
+private:
+    void store(uint32_t word, const WiegandDecoder &decoder);
+    void fire();
+
+    volatile uint32_t *blocks_[kBlocks];
+    uint8_t *bytes_[kBlocks]; // the same blocks as the store sees them
+    EdgeStore store_;
+    Condition cond_;
+    uint32_t post_;
+    uint32_t trigger_seq_; // the record that fired, numbered from arm()
+    uint32_t trigger_word_;
+    uint32_t last_bits_;   // decoder bit count at the previous record: a change is a new pulse
+    volatile State state_;
+};
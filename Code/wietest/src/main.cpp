@@ -6,10 +6,13 @@
 #include <cstring>
 #include <hardware/irq.h>
 #include <hardware/pio.h>
+#include <pico/time.h>
 
 #include <Adafruit_FT6206.h>
 #include "commands.h"
+#include "core_load.h"
 #include "display_modes.h"
+#include "raw_stream.h"
 #include "terminal.h"
 #include "serial_commands.h"
 #include "firmware_version.h"
@@ -33,10 +36,14 @@ constexpr uint8_t PIN_WIEGAND_C_TX_D1 = 14;
 constexpr uint8_t PIN_WIEGAND_A_LED = 0;
 constexpr uint8_t PIN_WIEGAND_B_LED = 5;
 constexpr uint8_t PIN_WIEGAND_C_LED = 15;
-constexpr float WIEGAND_RX_CLKDIV = 15.0f;  // 1:150 with system clock
-constexpr uint32_t WIEGAND_MESSAGE_QUIET_MS = 5;
+constexpr uint32_t WIEGAND_RX_TICK_NS = 1000;  // RX timestamp resolution (60 ns and up)
+constexpr uint32_t WIEGAND_FRAME_QUIET_US = 5000;  // default end-of-frame gap
 constexpr uint8_t PIN_TOUCH_INT = 27;
 
+// Port table: one row per Wiegand port, named a, b, c, ... in this order. The three on-board
+// ports share pio0; an expansion board adds rows on the remaining SMs of pio0 and on pio1 and
+// pio2 (four per block, WiegandPort::kMaxPorts in all). Each block loads the capture programs
+// once for all of its ports.
 static WiegandPort g_wiegand_ports[] = {
     WiegandPort(pio0, 0, 0, PIN_WIEGAND_A_D0, 0, PIN_WIEGAND_A_TX_D0, PIN_WIEGAND_A_TX_D1,
                 PIN_WIEGAND_A_LED),
@@ -45,25 +52,136 @@ static WiegandPort g_wiegand_ports[] = {
     WiegandPort(pio0, 2, 2, PIN_WIEGAND_C_D0, 2, PIN_WIEGAND_C_TX_D0, PIN_WIEGAND_C_TX_D1,
                 PIN_WIEGAND_C_LED),
 };
+constexpr size_t kPortCount = sizeof(g_wiegand_ports) / sizeof(g_wiegand_ports[0]);
+static_assert(kPortCount <= WiegandPort::kMaxPorts, "one state machine per port");
 
 TFT_eSPI tft;
 Adafruit_FT6206 touch;
-int g_wiegand_offset = -1;
 SerialCommandProcessor g_cmd(Serial);
 
 // Command handlers are defined in commands.cpp; register_commands wires them up.
 
-extern "C" void __isr pio0_irq0_handler()
+// Set once setup() has configured the ports; core1 waits for it before taking the RX IRQ.
+static volatile bool g_ports_ready = false;
+
+// Drain the RX FIFO of every port on pio whose FIFO-not-empty source is pending.
+static void service_pio_irq0(PIO pio)
 {
-    const uint32_t pending = pio0->ints0;
+    const uint32_t isr_start = core_load_isr_begin();
+    const uint32_t pending = pio->ints0;
     for (auto &port : g_wiegand_ports)
     {
         const uint32_t src_bit = 1u << (pis_sm0_rx_fifo_not_empty + port.sm_index());
-        if (pending & src_bit)
+        if (port.pio() == pio && (pending & src_bit))
         {
             port.handle_irq();
         }
     }
+    core_load_isr_end(isr_start);
+}
+
+extern "C" void __isr pio0_irq0_handler()
+{
+    service_pio_irq0(pio0);
+}
+
+#if NUM_PIOS > 1
+extern "C" void __isr pio1_irq0_handler()
+{
+    service_pio_irq0(pio1);
+}
+#endif
+
+#if NUM_PIOS > 2
+extern "C" void __isr pio2_irq0_handler()
+{
+    service_pio_irq0(pio2);
+}
+#endif
+
+// Count finished edge blocks for ports in DMA capture mode; their polls use the counts to
+// tell a lap of the ring from a short advance.
+static void __isr dma_irq1_handler()
+{
+    const uint32_t isr_start = core_load_isr_begin();
+    for (auto &port : g_wiegand_ports)
+    {
+        port.handle_dma_irq();
+    }
+    core_load_isr_end(isr_start);
+}
+
+// Capture IRQ and decode: on core1 in dual-core builds, otherwise part of loop(). The
+// end-of-frame alarms go on the same core, so they never race the capture IRQ.
+static void enable_rx_irq()
+{
+#if WIEGAND_DUAL_CORE
+    WiegandPort::use_alarm_pool(alarm_pool_create_with_unused_hardware_alarm(kPortCount));
+#else
+    WiegandPort::use_alarm_pool(alarm_pool_get_default());
+#endif
+    static const irq_handler_t kHandlers[NUM_PIOS] = {
+        pio0_irq0_handler,
+#if NUM_PIOS > 1
+        pio1_irq0_handler,
+#endif
+#if NUM_PIOS > 2
+        pio2_irq0_handler,
+#endif
+    };
+    // Only blocks that have ports get their interrupt.
+    bool used[NUM_PIOS] = {};
+    for (const auto &port : g_wiegand_ports)
+    {
+        used[pio_get_index(port.pio())] = true;
+    }
+    for (uint p = 0; p < NUM_PIOS; ++p)
+    {
+        if (used[p])
+        {
+            const uint irq = pio_get_irq_num(pio_get_instance(p), 0);
+            irq_set_exclusive_handler(irq, kHandlers[p]);
+            irq_set_enabled(irq, true);
+        }
+    }
+    // Shared, as the core and libraries may use the other DMA channels.
+    const uint dma_irq = dma_get_irq_num(WiegandPort::kDmaIrqIndex);
+    irq_add_shared_handler(dma_irq, dma_irq1_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(dma_irq, true);
+}
+
+static void process_rx_ports()
+{
+    for (auto &port : g_wiegand_ports)
+    {
+        port.process();
+    }
+}
+
+// Sleep until an interrupt or __sev() (an end-of-frame alarm, a frame queued by core1, serial
+// input, ...) or for at most timeout_us, counting it as idle time.
+static void wait_for_event(uint32_t timeout_us)
+{
+    const uint32_t idle_start = core_load_idle_begin();
+    best_effort_wfe_or_timeout(make_timeout_time_us(timeout_us));
+    core_load_idle_end(idle_start);
+}
+
+// Show and log every frame the RX side has finished.
+static void report_rx_messages()
+{
+    RxMessage msg;
+    while (g_rx_queue.pop(msg))
+    {
+        if (msg.port_id < kPortCount)
+        {
+            g_wiegand_ports[msg.port_id].report(msg);
+        }
+        else
+        {
+            msg.release();
+        }
+    }
 }
 
 void setup()
@@ -112,16 +230,22 @@ void setup()
         terminalAddLine("Touch init failed");
     }
 
-    // Load and start Wiegand A RX PIO: one SM per Wiegand input pin pair.
-    g_wiegand_offset = pio_add_program(pio0, &wiegand_rx2_program);
+    // Start Wiegand RX PIO: one SM per Wiegand input pin pair, sharing the loaded program.
     for (auto &port : g_wiegand_ports)
     {
-        port.init(g_wiegand_offset, WIEGAND_RX_CLKDIV);
+        port.set_frame_quiet_us(WIEGAND_FRAME_QUIET_US);
+        if (!port.init(WIEGAND_RX_TICK_NS))
+        {
+            terminalAddLine("RX PIO init failed");
+        }
     }
-    const size_t port_count = sizeof(g_wiegand_ports) / sizeof(g_wiegand_ports[0]);
-    register_commands(g_cmd, g_wiegand_ports, port_count);
-    irq_set_exclusive_handler(PIO0_IRQ_0, pio0_irq0_handler);
-    irq_set_enabled(PIO0_IRQ_0, true);
+    // Start all receivers on the same cycle so their timestamps share one timebase.
+    WiegandPort::sync_rx_timebase(g_wiegand_ports, kPortCount);
+    register_commands(g_cmd, g_wiegand_ports, kPortCount);
+#if !WIEGAND_DUAL_CORE
+    enable_rx_irq();
+#endif
+    g_ports_ready = true;
     Serial.println("\r\n\r\n\r\n");
     Serial.println("Wiegand Tester Running....");
 }
@@ -152,10 +276,35 @@ void loop()
 
     g_cmd.poll();
 
+#if !WIEGAND_DUAL_CORE
+    process_rx_ports();
+#endif
+    report_rx_messages();
+    const bool raw_waiting = raw_stream_pump(Serial);
     for (auto &port : g_wiegand_ports)
     {
-        port.process(WIEGAND_MESSAGE_QUIET_MS);
         port.tick();
     }
-    delay(5);
+    // The 5 ms cap keeps the LED timeouts and the DMA/bit-mode polls going when nothing
+    // else wakes the loop. Raw packets waiting on USB room get a shorter one.
+    wait_for_event(raw_waiting ? 100 : 5000);
+}
+
+#if WIEGAND_DUAL_CORE
+// Core1 owns the RX path: the PIO FIFO interrupt is enabled from here so it is taken on
+// this core, and finished frames go to core0 through g_rx_queue.
+void setup1()
+{
+    while (!g_ports_ready)
+    {
+        tight_loop_contents();
+    }
+    enable_rx_irq();
+}
+
+void loop1()
+{
+    process_rx_ports();
+    wait_for_event(1000); // DMA and bit-mode ports are polled, not interrupt-driven
 }
+#endif
@@ -0,0 +1,136 @@
+#include "raw_stream.h"
+
+#include <hardware/timer.h>
+
+#include "wiegand_port.h"
+
+RawChunkQueue g_raw_queue;
+
+namespace {
+
+constexpr size_t kHeaderBytes = 12;
+
+struct PortCounters
+{
+    uint32_t packets;
+    uint32_t records;
+    uint32_t lost;
+    uint32_t start_us;
+    uint32_t window_start_us; // one-second windows for the peak rate
+    uint32_t window_records;
+    uint32_t peak_per_s;
+};
+
+PortCounters g_counters[WiegandPort::kMaxPorts] = {};
+
+// The next packet, kept across calls until the output buffer has room for all of it.
+uint8_t g_packet[kHeaderBytes + RawChunk::kMaxWords * sizeof(uint32_t)];
+size_t g_packet_len = 0;
+uint32_t g_packet_lost = 0;
+bool g_packet_pending = false;
+
+void put_u32(uint8_t *out, uint32_t value)
+{
+    out[0] = static_cast<uint8_t>(value);
+    out[1] = static_cast<uint8_t>(value >> 8);
+    out[2] = static_cast<uint8_t>(value >> 16);
+    out[3] = static_cast<uint8_t>(value >> 24);
+}
+
+void encode(const RawChunk &chunk)
+{
+    g_packet[0] = 0xA5;
+    g_packet[1] = 0x5A;
+    g_packet[2] = chunk.port_id;
+    g_packet[3] = chunk.count;
+    put_u32(&g_packet[4], chunk.seq);
+    put_u32(&g_packet[8], chunk.lost);
+    for (uint32_t i = 0; i < chunk.count; ++i)
+    {
+        put_u32(&g_packet[kHeaderBytes + i * sizeof(uint32_t)], chunk.words[i]);
+    }
+    g_packet_len = kHeaderBytes + chunk.count * sizeof(uint32_t);
+    g_packet_lost = chunk.lost;
+    g_packet_pending = true;
+}
+
+void count_sent()
+{
+    const uint8_t port_id = g_packet[2];
+    if (port_id < WiegandPort::kMaxPorts)
+    {
+        PortCounters &c = g_counters[port_id];
+        c.packets += 1;
+        c.records += g_packet[3];
+        c.lost += g_packet_lost;
+        const uint32_t now = time_us_32();
+        if (now - c.window_start_us >= 1000000u)
+        {
+            const uint32_t rate = static_cast<uint32_t>(static_cast<uint64_t>(c.window_records) *
+                                                        1000000u / (now - c.window_start_us));
+            if (rate > c.peak_per_s)
+            {
+                c.peak_per_s = rate;
+            }
+            c.window_start_us = now;
+            c.window_records = 0;
+        }
+        c.window_records += g_packet[3];
+    }
+}
+
+} // namespace
+
+void raw_stream_start(uint port_id)
+{
+    if (port_id < WiegandPort::kMaxPorts)
+    {
+        const uint32_t now = time_us_32();
+        g_counters[port_id] = PortCounters{0, 0, 0, now, now, 0, 0};
+    }
+}
+
+bool raw_stream_pump(Print &out)
+{
+    for (;;)
+    {
+        if (!g_packet_pending)
+        {
+            RawChunk chunk;
+            if (!g_raw_queue.pop(chunk))
+            {
+                return false;
+            }
+            encode(chunk);
+        }
+        // Whole packets only, so command replies and frame reports never land inside one.
+        if (out.availableForWrite() < static_cast<int>(g_packet_len))
+        {
+            return true;
+        }
+        out.write(g_packet, g_packet_len);
+        g_packet_pending = false;
+        count_sent();
+    }
+}
+
+RawStreamStats raw_stream_stats(uint port_id)
+{
+    RawStreamStats stats{};
+    if (port_id >= WiegandPort::kMaxPorts)
+    {
+        return stats;
+    }
+    const PortCounters &c = g_counters[port_id];
+    stats.packets = c.packets;
+    stats.records = c.records;
+    stats.lost = c.lost;
+    stats.elapsed_us = time_us_32() - c.start_us;
+    stats.peak_per_s = c.peak_per_s;
+    if (stats.elapsed_us > 0)
+    {
+        stats.records_per_s = static_cast<uint32_t>(
+            static_cast<uint64_t>(stats.records) * 1000000u / stats.elapsed_us);
+    }
+    return stats;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "spsc_queue.h"
+
+// Raw edge streaming: ports in raw mode hand every wiegand_rx2 record to the host as binary
+// packets on the USB serial port, skipping the decoder, the terminal and the RX log.
+// Packets (little-endian) can sit between the text lines of command replies and frame
+// reports; text never contains the sync bytes:
+//
+//   0xA5 0x5A  port:u8  count:u8  seq:u32  lost:u32  word:u32 * count
+//
+// seq numbers the port's records since raw mode was turned on, counting lost ones, so the
+// first word is record seq. lost > 0 is an overflow marker: that many records were dropped
+// (the edge blocks filled while the host or the USB link fell behind) between the previous
+// packet's last record and this packet's first. A packet may carry only a marker (count 0).
+struct RawChunk
+{
+    static constexpr uint32_t kMaxWords = 32;
+
+    uint8_t port_id;
+    uint8_t count;
+    uint32_t seq;
+    uint32_t lost;
+    uint32_t words[kMaxWords];
+};
+
+// From the RX core (WiegandPort::process) to the main loop.
+using RawChunkQueue = SpscQueue<RawChunk, 16>;
+extern RawChunkQueue g_raw_queue;
+
+// Sent-side counters for one port since raw_stream_start().
+struct RawStreamStats
+{
+    uint32_t packets;
+    uint32_t records;
+    uint32_t lost;
+    uint32_t elapsed_us;
+    uint32_t records_per_s; // average rate over elapsed_us
+    uint32_t peak_per_s;    // best one-second window: the sustained rate the link kept up
+};
+
+// Main loop: start a port's counters, and write queued packets to out as far as its
+// buffer has room without blocking. Returns true if data is still waiting.
+void raw_stream_start(uint port_id);
+bool raw_stream_pump(Print &out);
+RawStreamStats raw_stream_stats(uint port_id);
@@ -0,0 +1,109 @@
+#include "rx_bench.h"
+
+#include <hardware/timer.h>
+
+namespace {
+
+// FIFO words one port should push for a frame of bits pulses.
+uint32_t expected_records(const WiegandPort &port, uint32_t bits)
+{
+    if (!port.rx_active())
+    {
+        return 0; // not listening
+    }
+    switch (port.rx_program())
+    {
+    case WiegandRxProgram::Pulses:
+        return bits;
+    case WiegandRxProgram::Bits:
+        return bits / 32 + 2; // full words, then the partial word and the count
+    case WiegandRxProgram::Edges:
+    default:
+        return bits * 2;
+    }
+}
+
+uint32_t records_taken(const WiegandPort::CaptureStats &st)
+{
+    return st.irq_edges + st.dma_edges;
+}
+
+} // namespace
+
+RxBenchResult rx_bench_run(WiegandPort *ports, size_t count, uint32_t bits, uint32_t pulse_us)
+{
+    if (count > WiegandPort::kMaxPorts)
+    {
+        count = WiegandPort::kMaxPorts;
+    }
+    RxBenchResult result{};
+    result.pulse_us = pulse_us;
+
+    WiegandPort::CaptureStats before[WiegandPort::kMaxPorts];
+    uint32_t quiet_us = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        before[i] = ports[i].capture_stats();
+        ports[i].take_rx_stall();
+        ports[i].force_rx_lines(false, false);
+        result.records_expected += expected_records(ports[i], bits);
+        result.ports += ports[i].rx_active() ? 1 : 0;
+        if (ports[i].frame_quiet_us() > quiet_us)
+        {
+            quiet_us = ports[i].frame_quiet_us();
+        }
+    }
+    busy_wait_us_32(pulse_us); // idle high before the first edge
+
+    const uint32_t start = time_us_32();
+    for (uint32_t bit = 0; bit < bits; ++bit)
+    {
+        const bool one = (bit & 1) != 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            ports[i].force_rx_lines(!one, one);
+        }
+        busy_wait_us_32(pulse_us);
+        for (size_t i = 0; i < count; ++i)
+        {
+            ports[i].force_rx_lines(false, false);
+        }
+        if (bit + 1 < bits)
+        {
+            busy_wait_us_32(pulse_us);
+        }
+    }
+    result.elapsed_us = time_us_32() - start;
+    result.edges_sent = result.ports * bits * 2;
+
+    // Let every frame end, so the bit program flushes and DMA ports are polled.
+    const uint32_t settle_start = time_us_32();
+    while (time_us_32() - settle_start < quiet_us + 2000)
+    {
+#if !WIEGAND_DUAL_CORE
+        for (size_t i = 0; i < count; ++i)
+        {
+            ports[i].process(); // this core is the RX core, and loop() is waiting on us
+        }
+#endif
+        busy_wait_us_32(100);
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        ports[i].release_rx_lines();
+        const WiegandPort::CaptureStats after = ports[i].capture_stats();
+        result.records_received += records_taken(after) - records_taken(before[i]);
+        result.dropped += after.dropped - before[i].dropped;
+        if (ports[i].take_rx_stall())
+        {
+            result.stalled += 1;
+        }
+    }
+    if (result.elapsed_us > 0)
+    {
+        result.edges_per_s = static_cast<uint32_t>(
+            static_cast<uint64_t>(result.edges_sent) * 1000000u / result.elapsed_us);
+    }
+    return result;
+}
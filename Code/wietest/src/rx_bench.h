@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "wiegand_port.h"
+
+// RX throughput benchmark. Every port gets the same train of bit pulses at once, generated
+// with the GPIO input overrides (WiegandPort::force_rx_lines), so the PIO programs, the
+// capture path and the decoder all run as they would with real readers on every port. The
+// generator runs on the calling core; in dual-core builds that leaves core1 to receive.
+struct RxBenchResult
+{
+    uint32_t ports;            // ports with RX running; the others are skipped
+    uint32_t pulse_us;         // low time of each pulse; the gap after it is the same
+    uint32_t edges_sent;       // across all ports, two per pulse
+    uint32_t records_expected; // FIFO words those edges should produce, given each rxprog
+    uint32_t records_received; // FIFO words the capture path took (IRQ or DMA)
+    uint32_t dropped;          // records lost to full edge buffers
+    uint32_t stalled;          // ports whose SM waited for FIFO space, so sampled late
+    uint32_t elapsed_us;       // first to last generated edge
+    uint32_t edges_per_s;      // edges_sent over elapsed_us
+
+    bool lossless() const
+    {
+        return records_received == records_expected && dropped == 0 && stalled == 0;
+    }
+};
+
+// Send bits pulses (alternating D0/D1) to every port, wait for the frames to finish and
+// compare what arrived. In single-core builds nothing decodes until the run is over, so keep
+// bits * 2 * ports within what the edge pool holds (and bits * 2 within one port's share).
+RxBenchResult rx_bench_run(WiegandPort *ports, size_t count, uint32_t bits, uint32_t pulse_us);
@@ -2,6 +2,8 @@
 
 #include <Arduino.h>
 
+#include "wiegand_frame.h"
+
 struct SerialCommand
 {
     const char *name;
@@ -20,7 +22,9 @@ public:
     void poll();
 
 private:
-    static constexpr size_t kMaxLineLength = 256;
+    // Room for a tx command carrying the longest frame in hex.
+    static constexpr size_t kMaxLineLength =
+        (2 * kWiegandMaxFrameBytes + 64 > 256) ? 2 * kWiegandMaxFrameBytes + 64 : 256;
     static constexpr size_t kMaxArgs = 12;
 
     void reset_buffer();
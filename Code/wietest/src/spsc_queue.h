@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Lock-free single-producer/single-consumer ring of fixed capacity (no allocation).
+// push() may only be called from one context (e.g. core1) and pop() from one other
+// (e.g. core0); the acquire/release pair on the indices orders the slot copies.
+template <typename T, size_t N>
+class SpscQueue
+{
+public:
+    static_assert(N > 0 && (N & (N - 1)) == 0, "capacity must be a power of two");
+
+    SpscQueue() : slots_{}, head_(0), tail_(0), dropped_(0) {}
+
+    // Producer side. Returns false (and counts a drop) when the consumer is N items behind.
+    bool push(const T &item)
+    {
+        const uint32_t head = head_.load(std::memory_order_relaxed);
+        const uint32_t tail = tail_.load(std::memory_order_acquire);
+        if (head - tail >= N)
+        {
+            dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+        slots_[head & (N - 1)] = item;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side.
+    bool pop(T &out)
+    {
+        const uint32_t tail = tail_.load(std::memory_order_relaxed);
+        const uint32_t head = head_.load(std::memory_order_acquire);
+        if (head == tail)
+        {
+            return false;
+        }
+        out = slots_[tail & (N - 1)];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Producer side: true when push() would fail.
+    bool full() const
+    {
+        return head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_acquire) >= N;
+    }
+
+    size_t size() const
+    {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    uint32_t dropped() const
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+private:
+    T slots_[N];
+    std::atomic<uint32_t> head_;
+    std::atomic<uint32_t> tail_;
+    std::atomic<uint32_t> dropped_;
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+
+// Timing rules a port's frames can be checked against as they are decoded, edge by edge.
+enum class ComplianceRule : uint8_t
+{
+    PulseShort, // pulse below pulse_min
+    PulseLong,  // pulse above pulse_max
+    GapShort,   // gap between pulses below gap_min
+    GapLong,    // gap between pulses above gap_max
+    Overlap,    // D0 and D1 low together
+};
+
+inline constexpr uint32_t kComplianceRules = 5;
+
+// Limits for one port. WiegandPort takes them in ns and hands the decoder ticks.
+struct ComplianceLimits
+{
+    bool enabled;
+    uint32_t pulse_min;
+    uint32_t pulse_max;
+    uint32_t gap_min;
+    uint32_t gap_max;
+    bool allow_overlap;
+};
+
+// Short names for reports, indexed by ComplianceRule.
+inline const char *compliance_rule_name(uint32_t rule)
+{
+    static const char *const kNames[kComplianceRules] = {"pulse_short", "pulse_long",
+                                                         "gap_short", "gap_long", "overlap"};
+    return (rule < kComplianceRules) ? kNames[rule] : "?";
+}
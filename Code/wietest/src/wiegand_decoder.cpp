@@ -0,0 +1,274 @@
+#include "wiegand_decoder.h"
+
+#include <cstring>
+
+WiegandDecoder::WiegandDecoder() : prev_levels_(0x3), glitch_count_(0), limits_{}
+{
+    reset();
+    clear_histograms();
+}
+
+void WiegandDecoder::clear_histograms()
+{
+    for (int line = 0; line < 2; ++line)
+    {
+        pulse_hist_[line].clear();
+        gap_hist_[line].clear();
+    }
+}
+
+void WiegandDecoder::reset()
+{
+    last_fall_ts_[0] = 0;
+    last_fall_ts_[1] = 0;
+    in_low_[0] = false;
+    in_low_[1] = false;
+    last_rise_ts_ = 0;
+    have_last_rise_ = false;
+    edge_count_ = 0;
+    first_ts_ = 0;
+    last_ts_ = 0;
+    pulse_line_[0].reset();
+    pulse_line_[1].reset();
+    pulse_any_.reset();
+    gap_.reset();
+    for (TimingStats &stats : gap_bits_)
+    {
+        stats.reset();
+    }
+    last_bit_ = kNoBit;
+    errors_ = 0;
+    std::memset(violations_, 0, sizeof(violations_));
+    std::memset(words_, 0, sizeof(words_));
+    bit_count_ = 0;
+    recent_bits_ = 0;
+    last_pulse_ = 0;
+    bits_pending_[0] = 0;
+    bits_pending_[1] = 0;
+    bits_pending_count_ = 0;
+    bits_full_words_ = 0;
+}
+
+void WiegandDecoder::feed(uint32_t word)
+{
+    // The PIO counter runs down, so elapsed ticks are earlier - later (mod 2^30).
+    const uint32_t ts = word >> 2;
+    const uint32_t levels = word & 0x3;
+    if (levels == prev_levels_)
+    {
+        glitch_count_ += 1; // the glitch filter rejected a change
+        return;
+    }
+    if (edge_count_ == 0)
+    {
+        first_ts_ = ts;
+    }
+    last_ts_ = ts;
+    edge_count_ += 1;
+    if (levels == 0 && prev_levels_ != 0)
+    {
+        errors_ |= kErrorOverlap;
+        if (limits_.enabled && !limits_.allow_overlap)
+        {
+            violate(ComplianceRule::Overlap);
+        }
+    }
+
+    for (int line = 0; line < 2; ++line)
+    {
+        const uint32_t mask = 1u << line;
+        const bool was_high = (prev_levels_ & mask) != 0;
+        const bool now_high = (levels & mask) != 0;
+        if (was_high && !now_high)
+        {
+            // Falling edge: start of low pulse.
+            if (have_last_rise_)
+            {
+                const uint32_t gap = (last_rise_ts_ - ts) & kTimestampMask;
+                gap_.add(gap);
+                gap_hist_[line].add(gap);
+                check_gap(gap);
+                if (last_bit_ != kNoBit && (levels & (mask ^ 0x3)) != 0)
+                {
+                    gap_bits_[(last_bit_ << 1) | static_cast<uint32_t>(line)].add(gap);
+                }
+            }
+            last_fall_ts_[line] = ts;
+            in_low_[line] = true;
+        }
+        else if (!was_high && now_high && in_low_[line])
+        {
+            // Rising edge: end of low pulse. D0 pulse -> 0, D1 pulse -> 1.
+            const uint32_t pulse = (last_fall_ts_[line] - ts) & kTimestampMask;
+            pulse_line_[line].add(pulse);
+            pulse_any_.add(pulse);
+            pulse_hist_[line].add(pulse);
+            check_pulse(pulse);
+            last_pulse_ = pulse;
+            in_low_[line] = false;
+            append_bit(line == 1);
+            // A pulse ending with the other line low overlapped it: no trustworthy bit.
+            last_bit_ = ((levels & (mask ^ 0x3)) != 0) ? static_cast<uint32_t>(line) : kNoBit;
+            last_rise_ts_ = ts;
+            have_last_rise_ = true;
+        }
+        else if (!was_high && now_high)
+        {
+            errors_ |= kErrorRunt; // its fall came before this frame (or was lost)
+        }
+    }
+    prev_levels_ = levels;
+}
+
+uint32_t WiegandDecoder::gap_before(uint32_t word) const
+{
+    if (edge_count_ == 0 || prev_levels_ != 0x3 || (word & 0x3) == prev_levels_)
+    {
+        return 0; // not after an idle spell, or not an edge
+    }
+    return (last_ts_ - (word >> 2)) & kTimestampMask;
+}
+
+uint32_t WiegandDecoder::gap_before_pulse(uint32_t word) const
+{
+    if (!have_last_rise_)
+    {
+        return 0;
+    }
+    return (last_rise_ts_ - ((word >> 15) & kPulseStampMask)) & kPulseStampMask;
+}
+
+void WiegandDecoder::feed_pulse(uint32_t word)
+{
+    // Same down-counter convention as feed(), but 15-bit stamps and one word per pulse.
+    const uint32_t lines = word >> 30;
+    const uint32_t fall_ts = (word >> 15) & kPulseStampMask;
+    const uint32_t rise_ts = word & kPulseStampMask;
+    edge_count_ += 2;
+
+    const bool valid = lines == 0x1 || lines == 0x2;
+    const int line = (lines == 0x2) ? 1 : 0;
+    if (have_last_rise_)
+    {
+        const uint32_t gap = (last_rise_ts_ - fall_ts) & kPulseStampMask;
+        gap_.add(gap);
+        check_gap(gap);
+        if (valid)
+        {
+            gap_hist_[line].add(gap);
+            if (last_bit_ != kNoBit)
+            {
+                gap_bits_[(last_bit_ << 1) | static_cast<uint32_t>(line)].add(gap);
+            }
+        }
+    }
+    last_rise_ts_ = rise_ts;
+    have_last_rise_ = true;
+    last_bit_ = valid ? static_cast<uint32_t>(line) : kNoBit;
+    if (!valid)
+    {
+        errors_ |= kErrorOverlap;
+        if (limits_.enabled && !limits_.allow_overlap)
+        {
+            violate(ComplianceRule::Overlap);
+        }
+        return; // both lines were low together: no valid bit
+    }
+
+    const uint32_t pulse = (fall_ts - rise_ts) & kPulseStampMask;
+    pulse_line_[line].add(pulse);
+    pulse_any_.add(pulse);
+    pulse_hist_[line].add(pulse);
+    check_pulse(pulse);
+    last_pulse_ = pulse;
+    append_bit(line == 1);
+}
+
+void WiegandDecoder::feed_bits(uint32_t word)
+{
+    // A full word already has the first bit in its MSB, which is the words_ layout.
+    if (bits_pending_count_ == 2)
+    {
+        if (bits_full_words_ < kWords)
+        {
+            words_[bits_full_words_] = bits_pending_[0];
+        }
+        bits_full_words_ += 1;
+        bits_pending_[0] = bits_pending_[1];
+        bits_pending_count_ = 1;
+    }
+    bits_pending_[bits_pending_count_] = word;
+    bits_pending_count_ += 1;
+}
+
+void WiegandDecoder::finish_bits()
+{
+    if (bits_pending_count_ < 2)
+    {
+        return; // no partial/count pair: nothing usable
+    }
+    // The bit count should cover the full words plus the partial one; if words were dropped
+    // it will not, so trust the words we actually have.
+    const uint32_t partial = bits_pending_[0];
+    const uint32_t tail_bits = bits_pending_[1] % 32;
+    if (tail_bits > 0 && bits_full_words_ < kWords)
+    {
+        words_[bits_full_words_] = partial << (32 - tail_bits);
+    }
+    bit_count_ = bits_full_words_ * 32 + tail_bits;
+    bits_pending_count_ = 0;
+}
+
+void WiegandDecoder::append_bit(bool bit_is_one)
+{
+    if (bit_count_ < kMaxBits && bit_is_one)
+    {
+        words_[bit_count_ / 32] |= 1u << (31 - (bit_count_ % 32));
+    }
+    bit_count_ += 1;
+    recent_bits_ = (recent_bits_ << 1) | (bit_is_one ? 1u : 0u);
+}
+
+void WiegandDecoder::violate(ComplianceRule rule)
+{
+    uint16_t &count = violations_[static_cast<uint32_t>(rule)];
+    if (count < UINT16_MAX)
+    {
+        count += 1;
+    }
+}
+
+size_t WiegandDecoder::copy_bits(uint8_t *out, size_t out_len, uint32_t bits) const
+{
+    if (bits > captured_bits())
+    {
+        bits = captured_bits();
+    }
+    const uint32_t byte_len = (bits + 7) / 8;
+    if (!out || byte_len > out_len)
+    {
+        return 0;
+    }
+
+    // Right-aligning puts (byte_len * 8 - bits) zero pad bits ahead of the first bit, so
+    // output byte k starts at stored bit 8k - pad, and the last byte ends at bit bits - 1.
+    const uint32_t pad = byte_len * 8 - bits;
+    for (uint32_t k = 0; k < byte_len; ++k)
+    {
+        const uint32_t first = (k == 0) ? 0 : (k * 8 - pad);
+        const uint32_t word_index = first / 32;
+        const uint32_t bit_in_word = first % 32;
+        uint64_t pair = static_cast<uint64_t>(words_[word_index]) << 32;
+        if (word_index + 1 < kWords)
+        {
+            pair |= words_[word_index + 1];
+        }
+        uint8_t value = static_cast<uint8_t>(pair >> (56 - bit_in_word));
+        if (k == 0)
+        {
+            value = static_cast<uint8_t>(value >> pad);
+        }
+        out[k] = value;
+    }
+    return byte_len;
+}
@@ -0,0 +1,332 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "wiegand_compliance.h"
+#include "wiegand_frame.h"
+
+// Running min/max/average of a timing value, in timer ticks.
+struct TimingStats
+{
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t count;
+
+    void reset()
+    {
+        min = UINT32_MAX;
+        max = 0;
+        sum = 0;
+        count = 0;
+    }
+
+    void add(uint32_t value)
+    {
+        if (value < min)
+        {
+            min = value;
+        }
+        if (value > max)
+        {
+            max = value;
+        }
+        sum += value;
+        count += 1;
+    }
+
+    // All three report 0 when nothing has been added.
+    uint32_t min_or_zero() const
+    {
+        return (count > 0) ? min : 0;
+    }
+
+    uint32_t avg() const
+    {
+        return (count > 0) ? static_cast<uint32_t>(sum / count) : 0;
+    }
+
+    uint32_t max_or_zero() const
+    {
+        return (count > 0) ? max : 0;
+    }
+};
+
+// Counts of a timing value in log-spaced bins, two per octave of timer ticks: bins 0 and 1
+// hold 0 and 1 tick, and bin b >= 2 starts at (2 + b % 2) << (b / 2 - 1) ticks (2, 3, 4, 6,
+// 8, 12, ...). The last bin also takes everything longer. Constant cost per value.
+struct TimingHistogram
+{
+    static constexpr uint32_t kBins = 48; // up to 12 << 20 ticks
+
+    uint32_t counts[kBins];
+
+    void clear()
+    {
+        for (uint32_t &count : counts)
+        {
+            count = 0;
+        }
+    }
+
+    void add(uint32_t ticks)
+    {
+        counts[bin(ticks)] += 1;
+    }
+
+    static uint32_t bin(uint32_t ticks)
+    {
+        if (ticks < 2)
+        {
+            return ticks;
+        }
+        const uint32_t msb = 31 - static_cast<uint32_t>(__builtin_clz(ticks));
+        const uint32_t b = 2 * msb + ((ticks >> (msb - 1)) & 1);
+        return (b < kBins) ? b : kBins - 1;
+    }
+
+    static uint32_t bin_start(uint32_t b)
+    {
+        return (b < 2) ? b : (2 + b % 2) << (b / 2 - 1);
+    }
+};
+
+// Incremental Wiegand decoder for wiegand_rx2 edge records ((timestamp << 2) | levels),
+// wiegand_rx_pulse records (lines << 30 | fall << 15 | rise) and wiegand_rx_bits words. Each
+// feed updates the pulse/gap statistics and shifts completed bits into a packed word buffer,
+// so sealing a frame needs no second pass over the records.
+class WiegandDecoder
+{
+public:
+    static constexpr uint32_t kMaxBits = kWiegandMaxFrameBits;
+
+    // What can be wrong with a frame, as bits of errors().
+    static constexpr uint8_t kErrorOverlap = 1u << 0;   // D0 and D1 low together
+    static constexpr uint8_t kErrorRunt = 1u << 1;      // a line rose without having fallen
+    static constexpr uint8_t kErrorTruncated = 1u << 2; // more than kMaxBits bits
+    static constexpr uint8_t kErrorLineLow = 1u << 3;   // ended with a line still low
+    static constexpr uint32_t kErrorKinds = 4;
+
+    WiegandDecoder();
+
+    // Start a new frame: no bits, no statistics. The line levels carry over, so a pulse that
+    // straddles the boundary shows as kErrorLineLow here and kErrorRunt in the next frame.
+    void reset();
+
+    // The line levels before the next edge: wiegand_rx2's first word after an SM (re)start is
+    // the initial levels, not an edge, and the port hands it over here rather than to feed().
+    void set_levels(uint32_t levels)
+    {
+        prev_levels_ = levels & 0x3;
+    }
+
+    void feed(uint32_t word);
+    void feed_pulse(uint32_t word);
+    // wiegand_rx_bits carries no timing, and its last two words (partial bits, bit count)
+    // are only known to be last when the frame is sealed: call finish_bits() then.
+    void feed_bits(uint32_t word);
+    void finish_bits();
+
+    // Level changes (or pulses) in this frame; wiegand_rx2 glitch markers are not counted.
+    uint32_t edge_count() const
+    {
+        return edge_count_;
+    }
+
+    // Idle ticks between the frame so far and the edge or pulse in word, for splitting
+    // back-to-back frames before feeding it. 0 if word would be the frame's first, or is not
+    // an edge (a glitch marker). Pulse stamps are 15 bits, so longer gaps alias.
+    uint32_t gap_before(uint32_t word) const;
+    uint32_t gap_before_pulse(uint32_t word) const;
+
+    // wiegand_rx2 glitch markers seen since construction (not cleared by reset()).
+    uint32_t glitch_count() const
+    {
+        return glitch_count_;
+    }
+
+    // Bits seen in this frame, including any beyond kMaxBits that could not be stored.
+    uint32_t bit_count() const
+    {
+        return bit_count_;
+    }
+
+    uint32_t captured_bits() const
+    {
+        return (bit_count_ > kMaxBits) ? kMaxBits : bit_count_;
+    }
+
+    bool truncated() const
+    {
+        return bit_count_ > kMaxBits;
+    }
+
+    // kError* bits for the frame so far. The line-low check needs edge records.
+    uint8_t errors() const
+    {
+        return static_cast<uint8_t>(errors_ | (truncated() ? kErrorTruncated : 0) |
+                                    ((in_low_[0] || in_low_[1]) ? kErrorLineLow : 0));
+    }
+
+    // First and last edge of the frame as wiegand_rx2 ticks since its SM started (the counter
+    // runs down from 0). Ports started together by WiegandPort::sync_rx_timebase() share this
+    // count. 0 when no edge record has been fed.
+    uint32_t first_tick() const
+    {
+        return ticks_since_start(first_ts_);
+    }
+
+    uint32_t last_tick() const
+    {
+        return ticks_since_start(last_ts_);
+    }
+
+    // The frame's latest bits, newest in bit 0 (fewer than 32 if bit_count() is).
+    uint32_t recent_bits() const
+    {
+        return recent_bits_;
+    }
+
+    // Width of the latest pulse, 0 before the first.
+    uint32_t last_pulse() const
+    {
+        return last_pulse_;
+    }
+
+    // Active-low pulse widths on either line.
+    const TimingStats &pulse() const
+    {
+        return pulse_any_;
+    }
+
+    // Pulse widths on one line (0 = D0, 1 = D1).
+    const TimingStats &pulse(int line) const
+    {
+        return pulse_line_[line];
+    }
+
+    // Gap from the end of one pulse to the start of the next.
+    const TimingStats &gap() const
+    {
+        return gap_;
+    }
+
+    // Gaps by the bits either side, index (previous << 1) | next: 0->0, 0->1, 1->0, 1->1.
+    // Gaps next to a pulse with both lines low are left out.
+    const TimingStats &gap(uint32_t transition) const
+    {
+        return gap_bits_[transition];
+    }
+
+    // Pulse widths and the gaps before each pulse, by line (0 = D0, 1 = D1), accumulated
+    // over every frame since construction or the last clear_histograms() (reset() keeps them).
+    const TimingHistogram &pulse_histogram(int line) const
+    {
+        return pulse_hist_[line];
+    }
+
+    const TimingHistogram &gap_histogram(int line) const
+    {
+        return gap_hist_[line];
+    }
+
+    void clear_histograms();
+
+    // Compliance checking (limits in ticks; kept by reset()). violations() counts each rule's
+    // breaches in this frame, saturating at 0xFFFF.
+    void set_limits(const ComplianceLimits &limits)
+    {
+        limits_ = limits;
+    }
+
+    const ComplianceLimits &limits() const
+    {
+        return limits_;
+    }
+
+    uint16_t violations(ComplianceRule rule) const
+    {
+        return violations_[static_cast<uint32_t>(rule)];
+    }
+
+    // Write the first bits captured bits (all of them by default) right-aligned and MSB-first
+    // (the RxMessage/bit_utils layout). Returns the number of bytes written, or 0 if out_len
+    // is too small.
+    size_t copy_bits(uint8_t *out, size_t out_len, uint32_t bits = kMaxBits) const;
+
+private:
+    static constexpr uint32_t kWords = kMaxBits / 32;
+    static constexpr uint32_t kTimestampMask = (1u << 30) - 1; // PIO counter width
+    static constexpr uint32_t kPulseStampMask = (1u << 15) - 1; // wiegand_rx_pulse stamps
+    static constexpr uint32_t kNoBit = 2;
+
+    void append_bit(bool bit_is_one);
+    void violate(ComplianceRule rule);
+
+    void check_pulse(uint32_t pulse)
+    {
+        if (limits_.enabled)
+        {
+            if (pulse < limits_.pulse_min)
+            {
+                violate(ComplianceRule::PulseShort);
+            }
+            if (pulse > limits_.pulse_max)
+            {
+                violate(ComplianceRule::PulseLong);
+            }
+        }
+    }
+
+    void check_gap(uint32_t gap)
+    {
+        if (limits_.enabled)
+        {
+            if (gap < limits_.gap_min)
+            {
+                violate(ComplianceRule::GapShort);
+            }
+            if (gap > limits_.gap_max)
+            {
+                violate(ComplianceRule::GapLong);
+            }
+        }
+    }
+
+    static uint32_t ticks_since_start(uint32_t ts)
+    {
+        return (0u - ts) & kTimestampMask;
+    }
+
+    uint32_t prev_levels_;
+    uint32_t last_fall_ts_[2];
+    bool in_low_[2];
+    uint32_t last_rise_ts_;
+    bool have_last_rise_;
+    uint32_t edge_count_;
+    uint32_t glitch_count_;
+    uint32_t first_ts_;
+    uint32_t last_ts_;
+    TimingStats pulse_line_[2];
+    TimingStats pulse_any_;
+    TimingStats gap_;
+    TimingStats gap_bits_[4];
+    uint32_t last_bit_; // bit of the pulse before the next gap, kNoBit if it carried none
+    TimingHistogram pulse_hist_[2];
+    TimingHistogram gap_hist_[2];
+    uint8_t errors_;
+    ComplianceLimits limits_;
+    uint16_t violations_[kComplianceRules];
+
+    // Bit n lives in words_[n / 32] at bit (31 - n % 32): first received bit is the MSB.
+    uint32_t words_[kWords];
+    uint32_t bit_count_;
+    uint32_t recent_bits_;
+    uint32_t last_pulse_;
+
+    // wiegand_rx_bits: the two most recent words, held back until they are known to be data.
+    uint32_t bits_pending_[2];
+    uint32_t bits_pending_count_;
+    uint32_t bits_full_words_;
+};
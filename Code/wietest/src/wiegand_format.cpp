@@ -0,0 +1,129 @@
+#include "wiegand_format.h"
+
+uint64_t wiegand_frame_value(const uint8_t *data, size_t data_bytes)
+{
+    uint64_t value = 0;
+    const size_t first = (data_bytes > 8) ? data_bytes - 8 : 0;
+    for (size_t i = first; i < data_bytes; ++i)
+    {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+uint8_t wiegand_parity_errors(const WiegandFormat &format, uint64_t frame)
+{
+    uint8_t errors = 0;
+    for (uint32_t i = 0; i < format.parity_count; ++i)
+    {
+        const bool odd = (__builtin_popcountll(frame & format.parity[i].mask) & 1) != 0;
+        if (odd != format.parity[i].odd)
+        {
+            errors = static_cast<uint8_t>(errors | (1u << i));
+        }
+    }
+    return errors;
+}
+
+WiegandDecoded wiegand_decode_as(uint8_t format, uint64_t frame, bool inverted)
+{
+    const WiegandFormat &f = kWiegandFormats[format];
+    if (inverted)
+    {
+        frame = ~frame & wiegand_span(f.bits, 0, f.bits);
+    }
+    return WiegandDecoded{format, wiegand_parity_errors(f, frame), inverted,
+                          wiegand_field(frame, f.bits, f.facility),
+                          wiegand_field(frame, f.bits, f.card)};
+}
+
+WiegandDecoded wiegand_decode(const uint8_t *data, size_t data_bytes, uint32_t bit_count)
+{
+    WiegandDecoded best{kWiegandFormatRaw, 0, false, 0, 0};
+    if (bit_count == 0 || bit_count > 64)
+    {
+        return best;
+    }
+    const uint64_t frame = wiegand_frame_value(data, data_bytes);
+    for (size_t i = 0; i < kWiegandFormatCount; ++i)
+    {
+        if (kWiegandFormats[i].bits != bit_count)
+        {
+            continue;
+        }
+        for (int sense = 0; sense < 2; ++sense)
+        {
+            const WiegandDecoded d = wiegand_decode_as(static_cast<uint8_t>(i), frame, sense != 0);
+            if (best.format == kWiegandFormatRaw || (d.parity_errors == 0 && best.parity_errors != 0))
+            {
+                best = d;
+            }
+        }
+    }
+    return best;
+}
+
+const char *wiegand_format_name(uint8_t format)
+{
+    return (format < kWiegandFormatCount) ? kWiegandFormats[format].name : "raw";
+}
+
+WiegandFormatCache::WiegandFormatCache()
+    : format_(kWiegandFormatRaw),
+      inverted_(false),
+      misses_(0),
+      hits_(0),
+      searches_(0),
+      changes_(0)
+{
+}
+
+void WiegandFormatCache::reset()
+{
+    format_ = kWiegandFormatRaw;
+    inverted_ = false;
+    misses_ = 0;
+    hits_ = 0;
+    searches_ = 0;
+    changes_ = 0;
+}
+
+WiegandDecoded WiegandFormatCache::decode(const uint8_t *data, size_t data_bytes,
+                                          uint32_t bit_count)
+{
+    const uint8_t cached = format_;
+    if (cached != kWiegandFormatRaw && kWiegandFormats[cached].bits == bit_count)
+    {
+        const WiegandDecoded d =
+            wiegand_decode_as(cached, wiegand_frame_value(data, data_bytes), inverted_);
+        if (d.parity_errors == 0)
+        {
+            hits_ += 1;
+            misses_ = 0;
+            return d;
+        }
+    }
+    searches_ += 1;
+    const WiegandDecoded d = wiegand_decode(data, data_bytes, bit_count);
+    if (d.format != kWiegandFormatRaw && d.parity_errors == 0)
+    {
+        misses_ = 0;
+        if (d.format != cached || d.inverted != inverted_)
+        {
+            learn(d.format, d.inverted);
+        }
+    }
+    else if (cached != kWiegandFormatRaw && ++misses_ >= kMissesToForget)
+    {
+        learn(kWiegandFormatRaw, false);
+    }
+    return d;
+}
+
+void WiegandFormatCache::learn(uint8_t format, bool inverted)
+{
+    format_ = format;
+    inverted_ = inverted;
+    misses_ = 0;
+    changes_ += 1;
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Card formats as compile-time descriptors. Frames of up to 64 bits are handled as a
+// right-aligned value (the last bit received in bit 0), so a field or a parity group is a mask
+// and a parity check is one popcount.
+
+// Offset counts from the first bit received.
+struct WiegandField
+{
+    uint8_t offset;
+    uint8_t bits;
+};
+
+// The bits one parity bit covers, including itself: the group's popcount is odd for an odd
+// parity bit and even for an even one.
+struct WiegandParity
+{
+    uint64_t mask;
+    bool odd;
+};
+
+struct WiegandFormat
+{
+    static constexpr uint32_t kMaxParity = 3;
+
+    const char *name;
+    uint8_t bits;
+    WiegandField facility; // bits = 0: none
+    WiegandField card;
+    uint8_t parity_count;
+    WiegandParity parity[kMaxParity];
+};
+
+// Bits offset..offset + count - 1 of a frame_bits frame, counted from the first bit.
+constexpr uint64_t wiegand_span(uint32_t frame_bits, uint32_t offset, uint32_t count)
+{
+    return ((count >= 64) ? ~0ull : ((1ull << count) - 1)) << (frame_bits - offset - count);
+}
+
+// Leading even parity over the first lead bits, trailing odd parity over the last trail bits
+// (the groups may share a bit).
+constexpr WiegandFormat wiegand_split_parity_format(const char *name, uint8_t bits,
+                                                    WiegandField facility, WiegandField card,
+                                                    uint8_t lead, uint8_t trail)
+{
+    return WiegandFormat{name,
+                         bits,
+                         facility,
+                         card,
+                         2,
+                         {{wiegand_span(bits, 0, lead), false},
+                          {wiegand_span(bits, bits - trail, trail), true},
+                          {0, false}}};
+}
+
+inline constexpr WiegandFormat kWiegandFormats[] = {
+    wiegand_split_parity_format("H10301", 26, {1, 8}, {9, 16}, 13, 13),
+    wiegand_split_parity_format("H10306", 34, {1, 16}, {17, 16}, 17, 17),
+    wiegand_split_parity_format("H10304", 37, {1, 16}, {17, 19}, 19, 19),
+    // Corporate 1000: bit 2 even over every third pair, the last bit odd over the
+    // interleaved pairs, the first bit odd over the whole frame.
+    {"C1k35", 35, {2, 12}, {14, 20}, 3,
+     {{(3ull << 32) | 0xB6DB6DB6ull, false},
+      {(3ull << 32) | 0x6DB6DB6Cull | 1, true},
+      {wiegand_span(35, 0, 35), true}}},
+    {"C1k48", 48, {2, 22}, {24, 23}, 3,
+     {{(1ull << 46) | (0x1B6Dull << 32) | 0xB6DB6DB6ull, false},
+      {(0x36DBull << 32) | 0x6DB6DB6Cull | 1, true},
+      {wiegand_span(48, 0, 48), true}}},
+};
+
+inline constexpr size_t kWiegandFormatCount = sizeof(kWiegandFormats) / sizeof(kWiegandFormats[0]);
+
+// RxMessage::format for a frame no descriptor matched: the bits are reported as they are.
+inline constexpr uint8_t kWiegandFormatRaw = 0xFF;
+
+constexpr bool wiegand_format_valid(const WiegandFormat &f)
+{
+    const uint64_t frame = wiegand_span(f.bits, 0, f.bits);
+    if (f.bits == 0 || f.bits > 64 || f.parity_count > WiegandFormat::kMaxParity ||
+        f.card.bits == 0 || f.card.bits > 32 || f.facility.bits > 32 ||
+        f.card.offset + f.card.bits > f.bits || f.facility.offset + f.facility.bits > f.bits)
+    {
+        return false;
+    }
+    for (uint32_t i = 0; i < f.parity_count; ++i)
+    {
+        if (f.parity[i].mask == 0 || (f.parity[i].mask & ~frame) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+constexpr bool wiegand_formats_valid()
+{
+    for (const WiegandFormat &f : kWiegandFormats)
+    {
+        if (!wiegand_format_valid(f))
+        {
+            return false;
+        }
+    }
+    return kWiegandFormatCount < kWiegandFormatRaw;
+}
+
+static_assert(wiegand_formats_valid(), "a format's fields or parity groups leave its frame");
+
+// A right-aligned MSB-first buffer of data_bytes bytes as a value (its last 64 bits).
+uint64_t wiegand_frame_value(const uint8_t *data, size_t data_bytes);
+
+// Field value of a frame_bits frame.
+inline uint32_t wiegand_field(uint64_t frame, uint32_t frame_bits, WiegandField field)
+{
+    if (field.bits == 0)
+    {
+        return 0;
+    }
+    return static_cast<uint32_t>((frame >> (frame_bits - field.offset - field.bits)) &
+                                 ((1ull << field.bits) - 1));
+}
+
+// Bit i set for each parity group of format that fails; 0 is a good frame.
+uint8_t wiegand_parity_errors(const WiegandFormat &format, uint64_t frame);
+
+struct WiegandDecoded
+{
+    uint8_t format;        // index into kWiegandFormats, or kWiegandFormatRaw
+    uint8_t parity_errors; // see wiegand_parity_errors()
+    bool inverted;         // decoded from the inverted bits: D0 and D1 look swapped
+    uint32_t facility;
+    uint32_t card;
+};
+
+// A frame read as one format, in the given bit sense.
+WiegandDecoded wiegand_decode_as(uint8_t format, uint64_t frame, bool inverted);
+
+// Full search: every format of the frame's length, in both bit senses. A swapped D0/D1 pair
+// inverts every bit, which fails parity in every layout, so a layout whose parity only checks
+// out inverted points at the wiring. Prefers good parity, then the normal sense. Unmatched
+// lengths come back as kWiegandFormatRaw with zero fields.
+WiegandDecoded wiegand_decode(const uint8_t *data, size_t data_bytes, uint32_t bit_count);
+
+// Descriptor name for RxMessage::format ("raw" when none matched).
+const char *wiegand_format_name(uint8_t format);
+
+// Per-port auto-detection. A port usually sees one format, so once a full search finds a
+// format whose parity checks out, later frames are tried against it (in the bit sense it was
+// found in) first, and only a frame it does not fit costs a search. A search that settles on
+// a different format replaces it; kMissesToForget frames in a row that fit no format drop it.
+// Lives on the RX core with the port's decoder.
+class WiegandFormatCache
+{
+public:
+    static constexpr uint32_t kMissesToForget = 3;
+
+    WiegandFormatCache();
+
+    void reset();
+    WiegandDecoded decode(const uint8_t *data, size_t data_bytes, uint32_t bit_count);
+
+    // kWiegandFormatRaw while nothing is learned.
+    uint8_t format() const
+    {
+        return format_;
+    }
+
+    bool inverted() const
+    {
+        return inverted_;
+    }
+
+    uint32_t hits() const
+    {
+        return hits_;
+    }
+
+    uint32_t searches() const
+    {
+        return searches_;
+    }
+
+    uint32_t changes() const
+    {
+        return changes_;
+    }
+
+private:
+    void learn(uint8_t format, bool inverted);
+
+    volatile uint8_t format_;
+    volatile bool inverted_;
+    uint32_t misses_; // frames in a row the cached format did not decode
+    volatile uint32_t hits_;
+    volatile uint32_t searches_;
+    volatile uint32_t changes_; // formats learned, replaced or forgotten
+};
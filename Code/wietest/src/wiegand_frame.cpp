@@ -0,0 +1,35 @@
+#include "wiegand_frame.h"
+
+LongFrameStore g_long_frames;
+
+LongFrameStore::LongFrameStore()
+    : storage_{},
+      free_mask_((kSlots >= 32) ? 0xFFFFFFFFu : ((1u << kSlots) - 1)),
+      alloc_failures_(0)
+{
+}
+
+int LongFrameStore::alloc()
+{
+    uint32_t mask = free_mask_.load(std::memory_order_relaxed);
+    while (mask != 0)
+    {
+        const uint32_t slot = static_cast<uint32_t>(__builtin_ctz(mask));
+        if (free_mask_.compare_exchange_weak(mask, mask & ~(1u << slot),
+                                             std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            return static_cast<int>(slot);
+        }
+    }
+    alloc_failures_.fetch_add(1, std::memory_order_relaxed);
+    return -1;
+}
+
+void LongFrameStore::free(int slot)
+{
+    if (slot < 0 || static_cast<uint32_t>(slot) >= kSlots)
+    {
+        return;
+    }
+    free_mask_.fetch_or(1u << slot, std::memory_order_release);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Build with -D WIEGAND_MAX_FRAME_BITS=n (a multiple of 32) to receive, log and transmit frames
+// of up to n bits; the default is 256. Frames of up to 256 bits travel inside their RxMessage
+// as before, and only longer ones borrow one of WIEGAND_LONG_FRAME_SLOTS buffers of the full
+// size, so a build for 1024-bit bursts does not grow every queued and logged message.
+#ifndef WIEGAND_MAX_FRAME_BITS
+#define WIEGAND_MAX_FRAME_BITS 256
+#endif
+
+#ifndef WIEGAND_LONG_FRAME_SLOTS
+#define WIEGAND_LONG_FRAME_SLOTS 8
+#endif
+
+inline constexpr uint32_t kWiegandMaxFrameBits = WIEGAND_MAX_FRAME_BITS;
+inline constexpr size_t kWiegandMaxFrameBytes = kWiegandMaxFrameBits / 8;
+inline constexpr size_t kWiegandInlineFrameBytes =
+    (kWiegandMaxFrameBytes < 32) ? kWiegandMaxFrameBytes : 32;
+static_assert(kWiegandMaxFrameBits % 32 == 0 && kWiegandMaxFrameBits >= 64,
+              "frames are packed in 32-bit words and formats need 64 bits");
+static_assert(kWiegandMaxFrameBits <= 2040, "RxMessage::data_bytes is 8 bits");
+
+// Buffers for the bits of frames longer than an RxMessage holds. The RX side borrows one per
+// long frame and whoever drops the message (a full queue, or the RX log letting it go) gives
+// it back; the free set is a single atomic word, so that can happen on either core.
+class LongFrameStore
+{
+public:
+    static constexpr uint32_t kSlots =
+        (kWiegandMaxFrameBytes > kWiegandInlineFrameBytes) ? WIEGAND_LONG_FRAME_SLOTS : 0;
+    static_assert(kSlots <= 32, "the free set is one word");
+
+    LongFrameStore();
+
+    // Slot number, or -1 (and a failure counted) when every slot is out.
+    int alloc();
+    void free(int slot);
+
+    uint8_t *data(int slot)
+    {
+        return storage_[slot];
+    }
+
+    uint32_t free_slots() const
+    {
+        return static_cast<uint32_t>(__builtin_popcount(free_mask_.load(std::memory_order_relaxed)));
+    }
+
+    uint32_t alloc_failures() const
+    {
+        return alloc_failures_.load(std::memory_order_relaxed);
+    }
+
+private:
+    uint8_t storage_[(kSlots > 0) ? kSlots : 1][(kSlots > 0) ? kWiegandMaxFrameBytes : 1];
+    std::atomic<uint32_t> free_mask_;
+    std::atomic<uint32_t> alloc_failures_;
+};
+
+extern LongFrameStore g_long_frames;
@@ -3,8 +3,11 @@
 #include <cstring>
 #include <climits>
 #include <cstdio>
+#include <hardware/clocks.h>
 #include <hardware/gpio.h>
+#include <hardware/sync.h>
 #include "bit_utils.h"
+#include "raw_stream.h"
 #include "terminal.h"
 #include "wiegand_rx_log.h"
 
@@ -47,8 +50,18 @@ bool copy_right_aligned_bits(const uint8_t *src, size_t data_bytes, uint32_t bit
     return true;
 }
 
+// Terminal color per port, repeating past the fourth port.
+uint16_t port_color(uint port_id)
+{
+    // Green, then high contrast on black.
+    static const uint16_t kColors[] = {TFT_GREEN, TFT_MAGENTA, TFT_CYAN, TFT_YELLOW};
+    return kColors[port_id % (sizeof(kColors) / sizeof(kColors[0]))];
+}
+
 } // namespace
 
+alarm_pool_t *WiegandPort::eof_pool_ = nullptr;
+
 WiegandPort::WiegandPort(PIO pio, uint sm, uint irq_index, uint pin_base_d0, uint port_id,
                          uint tx_pin_d0, uint tx_pin_d1, uint led_pin)
     : pio_(pio),
@@ -59,9 +72,60 @@ WiegandPort::WiegandPort(PIO pio, uint sm, uint irq_index, uint pin_base_d0, uin
       tx_pin_d0_(tx_pin_d0),
       tx_pin_d1_(tx_pin_d1),
       led_pin_(led_pin),
-      buffer_{},
-      count_(0),
-      last_transition_ms_(0),
+      role_(Role::RxTx),
+      clk_div_(1.0f),
+      ns_per_tick_q16_(1000ull << 16),
+      rx_program_(WiegandRxProgram::Edges),
+      program_offset_(-1),
+      filter_us_(0),
+      filter_samples_(1),
+      timebase_synced_(false),
+      timebase_start_us_(0),
+      tick_cycles_q8_(150u << 8),
+      sys_hz_(150000000),
+      blocks_{},
+      slot_mask_(kBlockSlots - 1),
+      released_seq_(0),
+      blocks_held_(0),
+      blocks_peak_(0),
+      records_peak_(0),
+      alloc_failures_(0),
+      head_(0),
+      tail_(0),
+      open_start_(0),
+      sealed_ends_{},
+      sealed_wr_(0),
+      sealed_rd_(0),
+      quiet_us_(5000),
+      split_gap_ticks_(0),
+      last_edge_us_(0),
+      eof_alarm_(0),
+      decoder_(),
+      trigger_(),
+      format_cache_(),
+      compliance_ns_{false, 20000, 100000, 200000, 20000000, false},
+      compliance_totals_{},
+      error_counts_{},
+      stuck_lines_(0),
+      low_lines_(0),
+      low_since_us_{},
+      raw_stream_(false),
+      start_seq_(0),
+      start_pending_(false),
+      raw_seq_(0),
+      raw_dropped_(0),
+      loss_marks_{},
+      loss_wr_(0),
+      loss_rd_(0),
+      bit_frame_open_(false),
+      capture_mode_(CaptureMode::Irq),
+      dma_data_chan_(-1),
+      dma_ctrl_chan_(-1),
+      dma_blocks_done_(0),
+      irq_count_(0),
+      irq_edge_count_(0),
+      dma_edge_count_(0),
+      dropped_edge_count_(0),
       tx_timer_{},
       tx_active_(false),
       tx_state_(TxState::Idle),
@@ -73,256 +137,1321 @@ WiegandPort::WiegandPort(PIO pio, uint sm, uint irq_index, uint pin_base_d0, uin
       tx_buffer_{},
       led_off_deadline_ms_(0) {}
 
-void WiegandPort::init(uint program_offset, float clk_div)
+bool WiegandPort::init(uint32_t tick_ns)
 {
-    wiegand_rx2_program_init(pio_, sm_, program_offset, pin_base_d0_, clk_div);
-    // Enable IRQ when this SM's RX FIFO has data.
-    pio_set_irq0_source_enabled(
-        pio_, static_cast<pio_interrupt_source_t>(pis_sm0_rx_fifo_not_empty + sm_), true);
-    pio_sm_set_enabled(pio_, sm_, true);
-
     pinMode(tx_pin_d0_, OUTPUT);
     pinMode(tx_pin_d1_, OUTPUT);
     drive_idle();
     pinMode(led_pin_, OUTPUT);
     gpio_put(led_pin_, 1); // idle off (low-true)
+
+    apply_tick_ns(tick_ns);
+    apply_compliance();
+    if (role_ == Role::Tx || role_ == Role::Disabled)
+    {
+        return true;
+    }
+    return start_rx(); // on failure TX still works; RX stays off
+}
+
+bool WiegandPort::set_role(Role role)
+{
+    const bool want_rx = (role == Role::RxTx || role == Role::Rx);
+    if (want_rx && !rx_active() && !start_rx())
+    {
+        return false;
+    }
+    if (!want_rx)
+    {
+        stop_rx();
+    }
+    role_ = role;
+    if (!tx_allowed())
+    {
+        stop_tx();
+    }
+    if (role == Role::Disabled)
+    {
+        gpio_put(led_pin_, 1); // off (low-true)
+        led_off_deadline_ms_ = 0;
+    }
+    return true;
+}
+
+bool WiegandPort::start_rx()
+{
+    const int offset = wiegand_rx_program_acquire(pio_, rx_program_);
+    if (offset < 0)
+    {
+        return false;
+    }
+    program_offset_ = offset;
+    wiegand_rx2_program_init(pio_, sm_, static_cast<uint>(offset), pin_base_d0_, clk_div_,
+                             rx_program_, filter_samples_);
+    rewind_rx(); // restarts DMA too, if that is the capture mode
+    timebase_synced_ = false;
+    if (capture_mode_ == CaptureMode::Irq)
+    {
+        // Enable IRQ when this SM's RX FIFO has data.
+        pio_set_irq0_source_enabled(
+            pio_, static_cast<pio_interrupt_source_t>(pis_sm0_rx_fifo_not_empty + sm_), true);
+    }
+    pio_sm_set_enabled(pio_, sm_, true);
+    start_timebase(time_us_64());
+    return true;
+}
+
+void WiegandPort::stop_rx()
+{
+    if (!rx_active())
+    {
+        return;
+    }
+    pio_sm_set_enabled(pio_, sm_, false);
+    pio_set_irq0_source_enabled(
+        pio_, static_cast<pio_interrupt_source_t>(pis_sm0_rx_fifo_not_empty + sm_), false);
+    stop_dma();
+    pio_sm_clear_fifos(pio_, sm_);
+    const uint32_t irq_state = save_and_disable_interrupts();
+    if (eof_alarm_ != 0)
+    {
+        alarm_pool_cancel_alarm(eof_pool_, eof_alarm_);
+        eof_alarm_ = 0;
+    }
+    restore_interrupts(irq_state);
+    wiegand_rx_program_release(pio_, rx_program_);
+    program_offset_ = -1;
+    reset_buffer(); // the frame in progress goes too
+    bit_frame_open_ = false;
+    timebase_synced_ = false;
+}
+
+void WiegandPort::stop_tx()
+{
+    if (tx_active_)
+    {
+        cancel_repeating_timer(&tx_timer_);
+        tx_active_ = false;
+        tx_state_ = TxState::Idle;
+    }
+    drive_idle();
 }
 
 void WiegandPort::handle_irq()
 {
+    irq_count_ += 1;
+    const uint32_t now = time_us_32();
+    close_frame_if_quiet(now);
     while (!pio_sm_is_rx_fifo_empty(pio_, sm_))
     {
         const uint32_t word = pio_sm_get(pio_, sm_);
-        last_transition_ms_ = millis();
-        if (count_ < kBufferCapacity)
+        irq_edge_count_ += 1;
+        // Counted from the start of tail_'s block, so head_ never reuses a slot still in use.
+        if (head_ - (tail_ & ~(kBlockWords - 1)) < ring_capacity() && store_record(word))
+        {
+            head_ = head_ + 1;
+        }
+        else
         {
-            buffer_[count_++] = word;
+            // Blocks full of unprocessed frames, or the pool is out: drop and keep draining
+            // to prevent stalls.
+            note_dropped_record();
         }
-        // Otherwise drop and keep draining to prevent stalls.
     }
+    if (head_ - tail_ > records_peak_)
+    {
+        records_peak_ = head_ - tail_;
+    }
+    note_activity(now);
 }
 
-void WiegandPort::reset_buffer()
+void WiegandPort::note_dropped_record()
+{
+    dropped_edge_count_ += 1;
+    const uint8_t pending = static_cast<uint8_t>(loss_wr_ - loss_rd_);
+    LossMark &newest = loss_marks_[static_cast<uint8_t>(loss_wr_ - 1) % kLossMarks];
+    if (pending > 0 && (newest.seq == head_ || pending == kLossMarks))
+    {
+        newest.count += 1;
+        return;
+    }
+    loss_marks_[loss_wr_ % kLossMarks] = LossMark{head_, 1};
+    loss_wr_ = static_cast<uint8_t>(loss_wr_ + 1);
+}
+
+bool WiegandPort::store_record(uint32_t word)
+{
+    volatile uint32_t *&block = blocks_[(head_ / kBlockWords) & slot_mask_];
+    if (block == nullptr)
+    {
+        block = g_edge_pool.alloc();
+        if (block == nullptr)
+        {
+            alloc_failures_ += 1;
+            return false;
+        }
+        blocks_held_ += 1;
+        if (blocks_held_ > blocks_peak_)
+        {
+            blocks_peak_ = blocks_held_;
+        }
+    }
+    block[head_ & (kBlockWords - 1)] = word;
+    return true;
+}
+
+void WiegandPort::release_slot(uint32_t slot)
+{
+    if (blocks_[slot] != nullptr)
+    {
+        g_edge_pool.free(blocks_[slot]);
+        blocks_[slot] = nullptr;
+        blocks_held_ -= 1;
+    }
+}
+
+void WiegandPort::advance_tail(uint32_t end)
 {
+    // tail_ moves in the same critical section that returns the blocks behind it: the capture
+    // ISR's room check counts from tail_, and seeing the new tail_ first would let head_ move
+    // into a slot whose old block is about to be freed, taking the new records with it.
     noInterrupts();
-    count_ = 0;
+    tail_ = end;
+    if (dma_data_chan_ >= 0)
+    {
+        interrupts();
+        return; // the DMA ring keeps its blocks until stop_dma()
+    }
+    // Every block wholly before tail_ is decoded.
+    const uint32_t done = end & ~(kBlockWords - 1);
+    while (static_cast<int32_t>(done - released_seq_) > 0)
+    {
+        release_slot((released_seq_ / kBlockWords) & slot_mask_);
+        released_seq_ += kBlockWords;
+    }
+    // Caught up: the block head_ is filling goes back too, and the next record borrows a new
+    // one. released_seq_ stays put so that one is returned in turn.
+    if (end == head_)
+    {
+        release_slot((end / kBlockWords) & slot_mask_);
+    }
     interrupts();
 }
 
-uint32_t WiegandPort::buffer_level() const
+void WiegandPort::release_all_blocks()
+{
+    for (uint32_t slot = 0; slot < kBlockSlots; ++slot)
+    {
+        release_slot(slot);
+    }
+    released_seq_ = head_ & ~(kBlockWords - 1);
+}
+
+void WiegandPort::close_frame_if_quiet(uint32_t now_us)
+{
+    // New edges after a quiet gap start a new frame; seal the open one at the current head
+    // so process() can consume it even if it runs after the next frame has begun.
+    if (rx_program_ == WiegandRxProgram::Bits)
+    {
+        return; // words arrive every 32 bits, not per edge; flush_bit_frame() seals these
+    }
+    if (head_ - open_start_ < frame_min_records() || (now_us - last_edge_us_) < quiet_us_)
+    {
+        return;
+    }
+    if (static_cast<uint8_t>(sealed_wr_ - sealed_rd_) >= kSealedFrames)
+    {
+        return; // process() is far behind; let the frames merge rather than lose edges
+    }
+    sealed_ends_[sealed_wr_ % kSealedFrames] = head_;
+    sealed_wr_ = sealed_wr_ + 1;
+    open_start_ = head_;
+}
+
+void WiegandPort::reset_buffer()
 {
-    uint32_t count_snapshot;
     noInterrupts();
-    count_snapshot = count_;
+    const uint32_t end = head_;
+    open_start_ = end;
+    sealed_rd_ = sealed_wr_;
+    loss_rd_ = loss_wr_; // the records they fell between are gone too
+    start_pending_ = false;
     interrupts();
-    return count_snapshot;
+    decoder_.reset();
+    advance_tail(end);
+}
+
+uint32_t WiegandPort::buffer_level() const
+{
+    return head_ - tail_;
 }
 
-bool WiegandPort::message_ready(uint32_t quiet_ms) const
+bool WiegandPort::message_ready() const
 {
-    uint32_t count_snapshot;
-    uint32_t last_ms_snapshot;
+    bool sealed_pending;
+    uint32_t open_count;
+    uint32_t last_us_snapshot;
     noInterrupts();
-    count_snapshot = count_;
-    last_ms_snapshot = last_transition_ms_;
+    sealed_pending = (sealed_rd_ != sealed_wr_);
+    open_count = head_ - open_start_;
+    last_us_snapshot = last_edge_us_;
     interrupts();
-    if (count_snapshot < 2)
+    if (sealed_pending)
+    {
+        return true;
+    }
+    if (open_count < frame_min_records())
     {
         return false;
     }
-    const uint32_t now = millis();
-    return (now - last_ms_snapshot) >= quiet_ms;
+    const uint32_t now = time_us_32();
+    return (now - last_us_snapshot) >= quiet_us_;
 }
 
-bool WiegandPort::process(uint32_t quiet_ms)
+bool WiegandPort::seal_open_frame()
 {
-    if (!message_ready(quiet_ms))
+    bool sealed = false;
+    noInterrupts();
+    // Only once everything captured has been fed, so no edge can straddle the seal.
+    if (head_ == tail_ && head_ - open_start_ >= frame_min_records() &&
+        (time_us_32() - last_edge_us_) >= quiet_us_)
     {
-        return false;
+        open_start_ = head_;
+        sealed = true;
+    }
+    interrupts();
+    return sealed;
+}
+
+void WiegandPort::feed_decoder(uint32_t end)
+{
+    uint32_t seq = tail_;
+    if (static_cast<int32_t>(end - seq) <= 0)
+    {
+        return; // nothing new, or the DMA ring overwrote these records before we got here
     }
+    // Copied out a chunk at a time, so a DMA lap during the copy is caught before decoding.
+    constexpr uint32_t kChunkWords = 32;
+    uint32_t words[kChunkWords];
+    while (seq != end)
+    {
+        const uint32_t count = (end - seq < kChunkWords) ? end - seq : kChunkWords;
+        const uint32_t overwritten = copy_records(seq, count, words);
+        dropped_edge_count_ += overwritten;
+        feed_records(seq + overwritten, words + overwritten, count - overwritten);
+        seq += count;
+    }
+    // The decoder has everything it needs; hand the records back to the capture path.
+    advance_tail(end);
+}
 
-    // Snapshot count so we only process the records that were present on entry.
-    uint32_t local_count = count_;
-    if (local_count > kBufferCapacity)
-    {
-        local_count = kBufferCapacity;
-    }
-
-    uint32_t prev_levels = 0x3; // assume idle high on both lines
-    uint32_t last_fall_ts[2] = {0, 0};
-    bool in_low[2] = {false, false};
-    uint32_t min_low[2] = {UINT32_MAX, UINT32_MAX};
-    uint32_t max_low[2] = {0, 0};
-    uint64_t sum_low[2] = {0, 0};
-    uint32_t count_low[2] = {0, 0};
-    uint32_t min_low_any = UINT32_MAX;
-    uint32_t max_low_any = 0;
-    uint64_t sum_low_any = 0;
-    uint32_t count_low_any = 0;
-    uint32_t min_inter = UINT32_MAX;
-    uint32_t max_inter = 0;
-    uint64_t sum_inter = 0;
-    uint32_t count_inter = 0;
-    uint32_t last_rise_ts_any = 0;
-    bool have_last_rise = false;
-    const uint32_t wrap = (1u << 30);
-    uint8_t bit_stream[kMaxBits] = {0}; // raw bits as seen, MSB-first
-    uint32_t bit_count = 0;
-
-    for (uint32_t i = 0; i < local_count; ++i)
-    {
-        const uint32_t word = buffer_[i];
-        const uint32_t ts = word >> 2;
-        const uint32_t levels = word & 0x3;
-
-        // Track low pulse durations per line.
-        for (int line = 0; line < 2; ++line)
+void WiegandPort::feed_records(uint32_t seq, const uint32_t *words, uint32_t count)
+{
+    // Frames closer together than the quiet time are split here, in the same pass.
+    const uint32_t split = split_gap_ticks_;
+    switch (rx_program_)
+    {
+    case WiegandRxProgram::Pulses:
+        for (uint32_t i = 0; i < count; ++i)
         {
-            const uint32_t mask = 1u << line;
-            const bool was_high = (prev_levels & mask) != 0;
-            const bool now_high = (levels & mask) != 0;
-            if (was_high && !now_high)
+            if (split != 0 && decoder_.gap_before_pulse(words[i]) >= split)
             {
-                // Falling edge: start of low pulse.
-                if (have_last_rise)
-                {
-                    const uint32_t inter = (last_rise_ts_any >= ts)
-                                               ? (last_rise_ts_any - ts)
-                                               : (last_rise_ts_any + wrap - ts);
-                    if (inter < min_inter)
-                    {
-                        min_inter = inter;
-                    }
-                    if (inter > max_inter)
-                    {
-                        max_inter = inter;
-                    }
-                    sum_inter += inter;
-                    count_inter += 1;
-                }
-                last_fall_ts[line] = ts;
-                in_low[line] = true;
+                publish_frame();
             }
-            else if (!was_high && now_high && in_low[line])
+            decoder_.feed_pulse(words[i]);
+        }
+        break;
+    case WiegandRxProgram::Bits:
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            decoder_.feed_bits(words[i]);
+        }
+        break;
+    case WiegandRxProgram::Edges:
+    default:
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (start_pending_ && seq + i == start_seq_)
             {
-                // Rising edge: end of low pulse.
-                const uint32_t pulse = (last_fall_ts[line] >= ts)
-                                           ? (last_fall_ts[line] - ts)
-                                           : (last_fall_ts[line] + wrap - ts);
-                if (pulse < min_low[line])
-                {
-                    min_low[line] = pulse;
-                }
-                if (pulse > max_low[line])
-                {
-                    max_low[line] = pulse;
-                }
-                sum_low[line] += pulse;
-                count_low[line] += 1;
-                if (pulse < min_low_any)
-                {
-                    min_low_any = pulse;
-                }
-                if (pulse > max_low_any)
-                {
-                    max_low_any = pulse;
-                }
-                sum_low_any += pulse;
-                count_low_any += 1;
-                in_low[line] = false;
-
-                // Record bit: D0 pulse -> 0, D1 pulse -> 1
-                if (bit_count < kMaxBits)
-                {
-                    bit_stream[bit_count] = (line == 1) ? 1 : 0;
-                }
-                bit_count++;
-                last_rise_ts_any = ts;
-                have_last_rise = true;
+                decoder_.set_levels(words[i]); // the SM's start record, not an edge
+                start_pending_ = false;
+                continue;
             }
+            if (split != 0 && decoder_.gap_before(words[i]) >= split)
+            {
+                publish_frame();
+            }
+            decoder_.feed(words[i]);
+            trigger_.record(words[i], decoder_);
+        }
+        break;
+    }
+}
+
+bool WiegandPort::process()
+{
+    if (!rx_active())
+    {
+        return false;
+    }
+    if (raw_stream_)
+    {
+        stream_raw();
+        check_stuck_lines();
+        return false;
+    }
+    if (capture_mode_ == CaptureMode::Dma)
+    {
+        poll_dma();
+    }
+    const bool bits = (rx_program_ == WiegandRxProgram::Bits);
+    if (bits && bit_frame_quiet())
+    {
+        flush_bit_frame();
+    }
+    // After the capture polls, so last_edge_us_ covers what they just found.
+    check_stuck_lines();
+
+    // Feed everything captured so far, finishing a frame at each boundary the capture path sealed.
+    bool published = false;
+    for (;;)
+    {
+        bool at_boundary;
+        uint32_t end;
+        noInterrupts();
+        at_boundary = (sealed_rd_ != sealed_wr_);
+        end = at_boundary ? sealed_ends_[sealed_rd_ % kSealedFrames] : head_;
+        interrupts();
+        feed_decoder(end);
+        if (!at_boundary)
+        {
+            break;
         }
-        prev_levels = levels;
+        sealed_rd_ = sealed_rd_ + 1;
+        publish_frame();
+        published = true;
+    }
+    if (!bits && !published && seal_open_frame())
+    {
+        publish_frame();
+        published = true;
+    }
+    return published;
+}
+
+void WiegandPort::check_stuck_lines()
+{
+    // A line counts as stuck once it has been low on every check for kStuckLineUs with no
+    // capture activity in between; a pulse, or a train of them, restarts the clock. Each
+    // episode counts once.
+    const uint32_t now = time_us_32();
+    const uint32_t low = (gpio_get(pin_base_d0_) ? 0u : 1u) | (gpio_get(pin_base_d0_ + 1) ? 0u : 2u);
+    uint32_t stuck = 0;
+    for (int line = 0; line < 2; ++line)
+    {
+        const uint32_t mask = 1u << line;
+        if ((low & mask) == 0)
+        {
+            continue;
+        }
+        if ((stuck_lines_ & mask) != 0)
+        {
+            stuck |= mask; // stays stuck until it goes high, whatever the other line does
+            continue;
+        }
+        if ((low_lines_ & mask) == 0 ||
+            static_cast<int32_t>(last_edge_us_ - low_since_us_[line]) > 0)
+        {
+            low_since_us_[line] = now; // newly low, or there were edges since
+        }
+        else if (now - low_since_us_[line] >= kStuckLineUs)
+        {
+            stuck |= mask;
+        }
+    }
+    low_lines_ = low;
+    if ((stuck & ~stuck_lines_) != 0)
+    {
+        error_counts_.stuck += 1;
+    }
+    stuck_lines_ = stuck;
+}
+
+bool WiegandPort::bit_frame_quiet()
+{
+    // wiegand_rx_bits sets its SM's IRQ flag on every bit (the flag is not routed to the
+    // NVIC); a frame has ended once the flag has stayed clear for quiet_us_.
+    const uint32_t now = time_us_32();
+    if (pio_interrupt_get(pio_, sm_))
+    {
+        pio_interrupt_clear(pio_, sm_);
+        bit_frame_open_ = true;
+        note_activity(now);
+        return false;
+    }
+    return bit_frame_open_ && (now - last_edge_us_) >= quiet_us_;
+}
+
+void WiegandPort::note_activity(uint32_t now_us)
+{
+    // Runs in the capture path (or the poll for DMA and bit modes) on the RX core. One alarm
+    // per frame: it pushes itself back while edges keep coming, so later edges only store
+    // their time.
+    last_edge_us_ = now_us;
+    if (eof_alarm_ != 0 || eof_pool_ == nullptr)
+    {
+        return;
+    }
+    // The alarm must not fire between being added and eof_alarm_ being set.
+    const uint32_t irq_state = save_and_disable_interrupts();
+    const alarm_id_t id =
+        alarm_pool_add_alarm_in_us(eof_pool_, quiet_us_, eof_alarm_trampoline, this, true);
+    eof_alarm_ = (id > 0) ? id : 0; // 0: fired already; < 0: no slot, the poll catches it
+    restore_interrupts(irq_state);
+}
+
+int64_t WiegandPort::eof_alarm_trampoline(alarm_id_t id, void *user_data)
+{
+    (void)id;
+    return static_cast<WiegandPort *>(user_data)->handle_eof_alarm();
+}
+
+int64_t WiegandPort::handle_eof_alarm()
+{
+    // Runs in the alarm IRQ on the RX core.
+    const uint32_t quiet_for = time_us_32() - last_edge_us_;
+    if (quiet_for < quiet_us_)
+    {
+        return -static_cast<int64_t>(quiet_us_ - quiet_for); // more edges since it was set
+    }
+    eof_alarm_ = 0;
+    __sev(); // the RX loop waits in best_effort_wfe_or_timeout(): let it seal the frame now
+    return 0;
+}
+
+void WiegandPort::use_alarm_pool(alarm_pool_t *pool)
+{
+    eof_pool_ = pool;
+}
+
+void WiegandPort::flush_bit_frame()
+{
+    // Push the partial word (right-aligned) and the bit count (Y counts down from ~0), then
+    // restart the count. The SM is sitting in its idle poll, so the inserted instructions
+    // cannot split a bit.
+    pio_sm_exec_wait_blocking(pio_, sm_, pio_encode_push(false, true));
+    pio_sm_exec_wait_blocking(pio_, sm_, pio_encode_mov_not(pio_isr, pio_y));
+    pio_sm_exec_wait_blocking(pio_, sm_, pio_encode_push(false, true));
+    pio_sm_exec_wait_blocking(pio_, sm_, pio_encode_mov_not(pio_y, pio_null));
+    bit_frame_open_ = false;
+
+    // Both words must be in the port's blocks before the frame is sealed behind them.
+    while (!pio_sm_is_rx_fifo_empty(pio_, sm_))
+    {
+        tight_loop_contents();
+    }
+    if (capture_mode_ == CaptureMode::Dma)
+    {
+        busy_wait_us_32(1); // the last FIFO read can be a few cycles ahead of its write
+        poll_dma();
+    }
+    noInterrupts();
+    if (static_cast<uint8_t>(sealed_wr_ - sealed_rd_) < kSealedFrames)
+    {
+        sealed_ends_[sealed_wr_ % kSealedFrames] = head_;
+        sealed_wr_ = sealed_wr_ + 1;
     }
+    open_start_ = head_;
+    interrupts();
+}
 
-    const uint32_t avg_any = (count_low_any > 0)
-                                 ? static_cast<uint32_t>(sum_low_any / count_low_any)
-                                 : 0;
-    const uint32_t avg_inter = (count_inter > 0)
-                                   ? static_cast<uint32_t>(sum_inter / count_inter)
-                                   : 0;
+bool WiegandPort::set_raw_stream(bool on)
+{
+    if (on && rx_program_ != WiegandRxProgram::Edges)
+    {
+        return false;
+    }
+    reset_buffer(); // start (or go back to decoding) at a frame boundary
+    raw_stream_ = on;
+    raw_seq_ = 0;
+    raw_dropped_ = dropped_edge_count_;
+    return true;
+}
 
-    const uint32_t captured_bits = (bit_count > kMaxBits) ? kMaxBits : bit_count;
-    const bool truncated = (bit_count > kMaxBits);
-    const uint32_t byte_len = (captured_bits + 7) / 8;
-    uint8_t packed[kTxBufferBytes] = {0};
-    if (captured_bits > 0 && byte_len <= kTxBufferBytes)
+void WiegandPort::stream_raw()
+{
+    // Like process(), but the records go out in chunks as they are, with no frame handling.
+    // A full queue leaves them in the edge blocks, so a slow host shows up as dropped
+    // records (and lost counts in the stream) rather than a stall.
+    if (capture_mode_ == CaptureMode::Dma)
+    {
+        poll_dma();
+    }
+    bool pushed = false;
+    while (!g_raw_queue.full())
     {
-        const uint32_t total_bits = byte_len * 8;
-        const uint32_t offset = total_bits - captured_bits;
-        for (uint32_t i = 0; i < captured_bits; ++i)
+        // A DMA lap loses the oldest records, just ahead of tail_. The ISR loses the newest,
+        // so its markers wait until tail_ reaches the point where it dropped them, and a
+        // packet stops short of the next one.
+        noInterrupts();
+        uint32_t available = head_ - tail_;
+        uint32_t lost = 0;
+        if (capture_mode_ == CaptureMode::Dma)
         {
-            if (bit_stream[i])
+            lost = dropped_edge_count_ - raw_dropped_;
+        }
+        else
+        {
+            if (loss_rd_ != loss_wr_ && loss_marks_[loss_rd_ % kLossMarks].seq == tail_)
+            {
+                lost = loss_marks_[loss_rd_ % kLossMarks].count;
+                loss_rd_ = static_cast<uint8_t>(loss_rd_ + 1);
+            }
+            if (loss_rd_ != loss_wr_)
             {
-                bitutils_set_bit_msb(packed, offset + i);
+                const uint32_t before_loss = loss_marks_[loss_rd_ % kLossMarks].seq - tail_;
+                available = (before_loss < available) ? before_loss : available;
             }
         }
+        raw_dropped_ += lost;
+        interrupts();
+        if (available == 0 && lost == 0)
+        {
+            break;
+        }
+        RawChunk chunk;
+        chunk.port_id = static_cast<uint8_t>(port_id_);
+        chunk.count = static_cast<uint8_t>(
+            (available < RawChunk::kMaxWords) ? available : RawChunk::kMaxWords);
+        const uint32_t end = tail_ + chunk.count;
+        const uint32_t overwritten = copy_records(tail_, chunk.count, chunk.words);
+        if (overwritten > 0)
+        {
+            // The DMA lapped the front of the chunk while it was copied: those are lost too.
+            dropped_edge_count_ += overwritten;
+            raw_dropped_ += overwritten;
+            lost += overwritten;
+            chunk.count = static_cast<uint8_t>(chunk.count - overwritten);
+            std::memmove(chunk.words, chunk.words + overwritten, chunk.count * sizeof(uint32_t));
+        }
+        chunk.lost = lost;
+        raw_seq_ += lost;
+        chunk.seq = raw_seq_;
+        g_raw_queue.push(chunk);
+        pushed = true;
+        raw_seq_ += chunk.count;
+        advance_tail(end);
     }
+    if (pushed)
+    {
+        __sev(); // the main loop writes the packets
+    }
+}
 
+void WiegandPort::publish_frame()
+{
+    if (rx_program_ == WiegandRxProgram::Bits)
+    {
+        decoder_.finish_bits();
+    }
+    if (rx_program_ == WiegandRxProgram::Edges && decoder_.edge_count() == 0)
+    {
+        decoder_.reset(); // nothing but glitch markers
+        return;
+    }
+    if (rx_program_ == WiegandRxProgram::Edges)
+    {
+        trigger_.frame_end(decoder_.bit_count());
+    }
+    RxMessage msg{};
+    msg.port_id = port_id_;
+    msg.bit_count = decoder_.captured_bits();
+    msg.truncated = decoder_.truncated();
+    msg.pulse_min = ticks_to_ns(decoder_.pulse().min_or_zero());
+    msg.pulse_avg = ticks_to_ns(decoder_.pulse().avg());
+    msg.pulse_max = ticks_to_ns(decoder_.pulse().max_or_zero());
+    msg.inter_min = ticks_to_ns(decoder_.gap().min_or_zero());
+    msg.inter_avg = ticks_to_ns(decoder_.gap().avg());
+    msg.inter_max = ticks_to_ns(decoder_.gap().max_or_zero());
+    for (int line = 0; line < 2; ++line)
+    {
+        msg.pulse_line[line] = timing_ns(decoder_.pulse(line));
+    }
+    for (uint32_t transition = 0; transition < 4; ++transition)
+    {
+        msg.gap_bits[transition] = timing_ns(decoder_.gap(transition));
+    }
+    msg.errors = decoder_.errors();
+    error_counts_.overlap += (msg.errors & WiegandDecoder::kErrorOverlap) ? 1 : 0;
+    error_counts_.runt += (msg.errors & WiegandDecoder::kErrorRunt) ? 1 : 0;
+    error_counts_.truncated += (msg.errors & WiegandDecoder::kErrorTruncated) ? 1 : 0;
+    error_counts_.line_low += (msg.errors & WiegandDecoder::kErrorLineLow) ? 1 : 0;
+    if (decoder_.limits().enabled && rx_program_ != WiegandRxProgram::Bits)
+    {
+        bool failed = false;
+        for (uint32_t rule = 0; rule < kComplianceRules; ++rule)
+        {
+            const uint16_t count = decoder_.violations(static_cast<ComplianceRule>(rule));
+            msg.violations[rule] = count;
+            compliance_totals_.violations[rule] += count;
+            failed = failed || count > 0;
+        }
+        msg.checked = true;
+        msg.compliant = !failed;
+        compliance_totals_.frames += 1;
+        compliance_totals_.failed += failed ? 1 : 0;
+    }
+    if (rx_program_ == WiegandRxProgram::Edges && decoder_.edge_count() > 0)
+    {
+        // Edges are stamped when the glitch filter accepts them, filter_samples_ - 1 ticks
+        // after the level changed.
+        const uint64_t now_us = time_us_64();
+        const uint32_t late = filter_samples_ - 1;
+        msg.start_tick = unwrap_ticks(decoder_.first_tick(), now_us) - late;
+        msg.end_tick = unwrap_ticks(decoder_.last_tick(), now_us) - late;
+        msg.start_us = ticks_to_us(msg.start_tick);
+        msg.end_us = ticks_to_us(msg.end_tick);
+    }
+    else
+    {
+        const uint32_t since_us = time_us_32() - last_edge_us_;
+        msg.start_us = time_us_64() - since_us;
+        msg.end_us = msg.start_us;
+    }
+    // Bits that do not fit the message borrow a long frame slot; with none free, keep what
+    // fits and call the frame truncated.
+    uint8_t *bits = msg.data;
+    size_t bits_len = sizeof(msg.data);
+    if (msg.bit_count > bits_len * 8)
+    {
+        const int slot = g_long_frames.alloc();
+        if (slot >= 0)
+        {
+            bits = g_long_frames.data(slot);
+            bits_len = kWiegandMaxFrameBytes;
+            msg.long_frame = static_cast<uint8_t>(slot + 1);
+        }
+        else
+        {
+            error_counts_.truncated += msg.truncated ? 0 : 1;
+            msg.bit_count = static_cast<uint32_t>(bits_len * 8);
+            msg.truncated = true;
+            msg.errors |= WiegandDecoder::kErrorTruncated;
+        }
+    }
+    msg.data_bytes = static_cast<uint8_t>(decoder_.copy_bits(bits, bits_len, msg.bit_count));
+    if (!msg.truncated)
+    {
+        const WiegandDecoded card = format_cache_.decode(bits, msg.data_bytes, msg.bit_count);
+        msg.format = card.format;
+        msg.parity_errors = card.parity_errors;
+        msg.inverted = card.inverted;
+        msg.facility = card.facility;
+        msg.card = card.card;
+    }
+    else
+    {
+        msg.format = kWiegandFormatRaw;
+    }
+    decoder_.reset();
+    // Terminal, log and LED work happens in report() on the main loop; wake it if it waits.
+    if (!g_rx_queue.push(msg))
+    {
+        msg.release();
+    }
+    __sev();
+}
+
+void WiegandPort::report(const RxMessage &msg)
+{
     const char port_letter = static_cast<char>('A' + port_id_);
-    char summary[96];
-    std::snprintf(summary, sizeof(summary), "rx %c %lub%s %lu/%lu/%lu %lu/%lu/%lu", port_letter,
-                  static_cast<unsigned long>(captured_bits), truncated ? "+" : "",
-                  static_cast<unsigned long>((count_low_any > 0) ? min_low_any : 0),
-                  static_cast<unsigned long>(avg_any),
-                  static_cast<unsigned long>((count_low_any > 0) ? max_low_any : 0),
-                  static_cast<unsigned long>((count_inter > 0) ? min_inter : 0),
-                  static_cast<unsigned long>(avg_inter),
-                  static_cast<unsigned long>((count_inter > 0) ? max_inter : 0));
+    char summary[112];
+    std::snprintf(summary, sizeof(summary), "rx %c %lub%s %lu/%lu/%lu %lu/%lu/%lu%s", port_letter,
+                  static_cast<unsigned long>(msg.bit_count), msg.truncated ? "+" : "",
+                  static_cast<unsigned long>(msg.pulse_min / 1000),
+                  static_cast<unsigned long>(msg.pulse_avg / 1000),
+                  static_cast<unsigned long>(msg.pulse_max / 1000),
+                  static_cast<unsigned long>(msg.inter_min / 1000),
+                  static_cast<unsigned long>(msg.inter_avg / 1000),
+                  static_cast<unsigned long>(msg.inter_max / 1000),
+                  msg.inverted ? " D0/D1 swapped?" : "");
 
     // Emit captured bits in hex.
     char hexline[2 * kTxBufferBytes + 3]; // "0x" + 2 chars per byte + null
-    if (!bitutils_format_hex_msb(packed, captured_bits, hexline, sizeof(hexline)))
+    if (!bitutils_format_hex_msb(msg.bits(), msg.bit_count, hexline, sizeof(hexline)))
     {
         std::snprintf(hexline, sizeof(hexline), "0x");
     }
-    // Choose display color per port.
-    uint16_t color = TFT_GREEN;
-    if (port_id_ == 1)
-    {
-        color = TFT_MAGENTA; // high contrast on black
-    }
-    else if (port_id_ == 2)
-    {
-        color = TFT_CYAN;
-    }
-    terminalSetColor(color);
+    terminalSetColor(port_color(port_id_));
     terminalAddLine(summary);
     terminalAddIndentedLine(hexline);
     terminalResetColor();
 
     // Stash the raw message and timing into the shared RX log buffer.
-    RxMessage msg{};
-    msg.port_id = port_id_;
-    msg.bit_count = captured_bits;
-    msg.pulse_min = (count_low_any > 0) ? min_low_any : 0;
-    msg.pulse_avg = avg_any;
-    msg.pulse_max = (count_low_any > 0) ? max_low_any : 0;
-    msg.inter_min = (count_inter > 0) ? min_inter : 0;
-    msg.inter_avg = avg_inter;
-    msg.inter_max = (count_inter > 0) ? max_inter : 0;
-    msg.data_bytes = static_cast<uint8_t>(byte_len);
-    if (msg.data_bytes > sizeof(msg.data))
-    {
-        msg.data_bytes = sizeof(msg.data); // truncate defensively
-    }
-    std::memcpy(msg.data, packed, msg.data_bytes);
     g_rx_log_buffer.push(msg);
 
     trigger_led();
+}
+
+bool WiegandPort::set_capture_mode(CaptureMode mode)
+{
+    if (mode == capture_mode_)
+    {
+        return true;
+    }
+    if (!rx_active())
+    {
+        capture_mode_ = mode; // start_rx() sets it up
+        return true;
+    }
+    const pio_interrupt_source_t fifo_source =
+        static_cast<pio_interrupt_source_t>(pis_sm0_rx_fifo_not_empty + sm_);
+    if (mode == CaptureMode::Dma)
+    {
+        // Stop the FIFO interrupt first so the handler and DMA never race for words.
+        pio_set_irq0_source_enabled(pio_, fifo_source, false);
+        if (!start_dma())
+        {
+            pio_set_irq0_source_enabled(pio_, fifo_source, true);
+            return false;
+        }
+        capture_mode_ = CaptureMode::Dma;
+        return true;
+    }
+
+    stop_dma();
+    capture_mode_ = CaptureMode::Irq;
     reset_buffer();
+    pio_set_irq0_source_enabled(pio_, fifo_source, true);
     return true;
 }
 
+bool WiegandPort::set_rx_program(WiegandRxProgram program)
+{
+    if (program == rx_program_)
+    {
+        return true;
+    }
+    if (!rx_active())
+    {
+        trigger_.disarm();
+        raw_stream_ = false;
+        rx_program_ = program; // loaded by start_rx()
+        return true;
+    }
+    const int offset = wiegand_rx_program_acquire(pio_, program);
+    if (offset < 0)
+    {
+        return false;
+    }
+
+    // Records already captured are in the old format, so drop them along with the old program.
+    trigger_.disarm();
+    raw_stream_ = false;
+    pio_sm_set_enabled(pio_, sm_, false);
+    wiegand_rx_program_release(pio_, rx_program_);
+    rx_program_ = program;
+    program_offset_ = offset;
+    wiegand_rx2_program_init(pio_, sm_, static_cast<uint>(offset), pin_base_d0_, clk_div_,
+                             rx_program_, filter_samples_);
+    rewind_rx();
+    timebase_synced_ = false; // restarted on its own
+    pio_sm_set_enabled(pio_, sm_, true);
+    start_timebase(time_us_64());
+    return true;
+}
+
+void WiegandPort::set_glitch_filter_us(uint32_t us)
+{
+    filter_us_ = us;
+    apply_glitch_filter();
+}
+
+void WiegandPort::apply_glitch_filter()
+{
+    const uint64_t ticks = span_ticks(filter_us_);
+    filter_samples_ = (ticks < kWiegandRx2MaxFilterSamples)
+                          ? static_cast<uint32_t>(ticks) + 1
+                          : kWiegandRx2MaxFilterSamples;
+    if (rx_program_ == WiegandRxProgram::Edges && program_offset_ >= 0)
+    {
+        wiegand_rx2_set_filter(pio_, sm_, filter_samples_);
+    }
+}
+
+uint32_t WiegandPort::glitch_filter_us() const
+{
+    return static_cast<uint32_t>(span_us(filter_samples_ - 1));
+}
+
+void WiegandPort::force_rx_lines(bool d0_low, bool d1_low)
+{
+    gpio_set_inover(pin_base_d0_, d0_low ? GPIO_OVERRIDE_LOW : GPIO_OVERRIDE_HIGH);
+    gpio_set_inover(pin_base_d0_ + 1, d1_low ? GPIO_OVERRIDE_LOW : GPIO_OVERRIDE_HIGH);
+}
+
+void WiegandPort::release_rx_lines()
+{
+    gpio_set_inover(pin_base_d0_, GPIO_OVERRIDE_NORMAL);
+    gpio_set_inover(pin_base_d0_ + 1, GPIO_OVERRIDE_NORMAL);
+}
+
+bool WiegandPort::take_rx_stall()
+{
+    const uint32_t flag = 1u << (PIO_FDEBUG_RXSTALL_LSB + sm_);
+    const bool stalled = (pio_->fdebug & flag) != 0;
+    pio_->fdebug = flag; // write 1 to clear
+    return stalled;
+}
+
+void WiegandPort::rewind_rx()
+{
+    // SM disabled: empty the capture path and point the SM back at the start of its program.
+    const bool dma = (capture_mode_ == CaptureMode::Dma);
+    if (dma)
+    {
+        stop_dma();
+    }
+    pio_sm_clear_fifos(pio_, sm_);
+    pio_sm_restart(pio_, sm_);
+    pio_sm_exec(pio_, sm_, pio_encode_set(pio_x, 0));
+    pio_sm_exec(pio_, sm_, pio_encode_mov(pio_isr, pio_null)); // wiegand_rx2 counter source
+    if (rx_program_ == WiegandRxProgram::Bits)
+    {
+        pio_sm_exec(pio_, sm_, pio_encode_mov_not(pio_y, pio_null)); // bit count starts at 0
+    }
+    const uint entry = wiegand_rx_program_entry(rx_program_, static_cast<uint>(program_offset_));
+    pio_sm_exec(pio_, sm_, pio_encode_jmp(entry));
+    reset_buffer();
+    pio_interrupt_clear(pio_, sm_);
+    bit_frame_open_ = false;
+    if (dma && !start_dma())
+    {
+        // The channels were just released, so this should not happen; fall back to the IRQ.
+        capture_mode_ = CaptureMode::Irq;
+        pio_set_irq0_source_enabled(
+            pio_, static_cast<pio_interrupt_source_t>(pis_sm0_rx_fifo_not_empty + sm_), true);
+    }
+    // The first record once the SM runs is the start record; the capture path is empty.
+    start_seq_ = head_;
+    start_pending_ = (rx_program_ == WiegandRxProgram::Edges);
+}
+
+void WiegandPort::sync_rx_timebase(WiegandPort *ports, size_t count)
+{
+    uint32_t masks[NUM_PIOS] = {};
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (ports[i].program_offset_ >= 0)
+        {
+            masks[pio_get_index(ports[i].pio_)] |= 1u << ports[i].sm_;
+        }
+    }
+    for (uint p = 0; p < NUM_PIOS; ++p)
+    {
+        if (masks[p] != 0)
+        {
+            pio_set_sm_mask_enabled(pio_get_instance(p), masks[p], false);
+        }
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (ports[i].program_offset_ >= 0)
+        {
+            ports[i].rewind_rx();
+            ports[i].timebase_synced_ = true;
+        }
+    }
+    // Enabling in sync also restarts the clock dividers, so the SMs tick together.
+#if NUM_PIOS == 3
+    pio_enable_sm_multi_mask_in_sync(pio1, masks[0], masks[1], masks[2]);
+#else
+    for (uint p = 0; p < NUM_PIOS; ++p)
+    {
+        if (masks[p] != 0)
+        {
+            pio_enable_sm_mask_in_sync(pio_get_instance(p), masks[p]);
+        }
+    }
+#endif
+    // One anchor for all of them, so equal ticks map to equal times.
+    const uint64_t now_us = time_us_64();
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (ports[i].program_offset_ >= 0)
+        {
+            ports[i].start_timebase(now_us);
+        }
+    }
+}
+
+void WiegandPort::set_tick_ns(uint32_t tick_ns)
+{
+    apply_tick_ns(tick_ns);
+    apply_glitch_filter(); // same time, new tick count
+    apply_compliance();
+    decoder_.clear_histograms(); // binned in the old ticks
+    if (program_offset_ < 0)
+    {
+        return;
+    }
+    // The counter now runs at another rate, so restart it with a fresh anchor.
+    pio_sm_set_enabled(pio_, sm_, false);
+    pio_sm_set_clkdiv(pio_, sm_, clk_div_);
+    rewind_rx();
+    timebase_synced_ = false;
+    pio_sm_set_enabled(pio_, sm_, true);
+    start_timebase(time_us_64());
+}
+
+void WiegandPort::apply_tick_ns(uint32_t tick_ns)
+{
+    // Divider in 16.8 fixed point, as the SM has it: tick = div * cycles / clk_sys. Clamped
+    // to the longest tick first, which keeps tick_ns * clk_sys * 256 inside 64 bits.
+    const uint64_t sys_hz = clock_get_hz(clk_sys);
+    constexpr uint64_t kCycles = kWiegandRx2CyclesPerTick;
+    const uint32_t longest = max_tick_ns();
+    if (tick_ns > longest)
+    {
+        tick_ns = longest;
+    }
+    uint64_t div_q8 = (static_cast<uint64_t>(tick_ns) * sys_hz * 256u + kCycles * 500000000u) /
+                      (kCycles * 1000000000u);
+    if (div_q8 < 256u)
+    {
+        div_q8 = 256u; // no divider: the shortest tick
+    }
+    else if (div_q8 > 0xFFFFFFu)
+    {
+        div_q8 = 0xFFFFFFu;
+    }
+    clk_div_ = static_cast<float>(div_q8) / 256.0f; // exact in a float
+    tick_cycles_q8_ = static_cast<uint32_t>(div_q8 * kCycles);
+    sys_hz_ = static_cast<uint32_t>(sys_hz);
+    // ns per tick, 16.16: div_q8 * cycles * 1e9 / clk_sys is ns in 24.8, so one more * 256,
+    // done in two steps to stay inside 64 bits.
+    const uint64_t ns_q8 = div_q8 * kCycles * 1000000000u;
+    ns_per_tick_q16_ = (ns_q8 / sys_hz) * 256u + (ns_q8 % sys_hz) * 256u / sys_hz;
+}
+
+uint32_t WiegandPort::max_tick_ns()
+{
+    // The largest 16.8 divider times the loop, rounded down so it stays reachable.
+    const uint64_t sys_hz = clock_get_hz(clk_sys);
+    return static_cast<uint32_t>(0xFFFFFFull * kWiegandRx2CyclesPerTick * 1000000000u /
+                                 (sys_hz * 256u));
+}
+
+uint64_t WiegandPort::counter_span_us() const
+{
+    // ticks * 2^bits in ns, from 16.16; a 4 ms tick is 2^38 in 16.16, so shift the difference.
+    const uint32_t bits = (rx_program_ == WiegandRxProgram::Pulses) ? 15 : 30;
+    const uint64_t span_ns =
+        (bits >= 16) ? ns_per_tick_q16_ << (bits - 16) : ns_per_tick_q16_ >> (16 - bits);
+    return span_ns / 1000u;
+}
+
+uint32_t WiegandPort::ns_to_ticks(uint32_t ns) const
+{
+    return static_cast<uint32_t>((static_cast<uint64_t>(ns) << 16) / ns_per_tick_q16_);
+}
+
+bool WiegandPort::arm_trigger(EdgeTrigger::Condition cond, uint32_t post)
+{
+    if (!rx_active() || rx_program_ != WiegandRxProgram::Edges)
+    {
+        return false;
+    }
+    cond.pulse_min = ns_to_ticks(cond.pulse_min);
+    cond.pulse_max = ns_to_ticks(cond.pulse_max);
+    return trigger_.arm(cond, post);
+}
+
+void WiegandPort::disarm_trigger()
+{
+    trigger_.disarm();
+}
+
+uint32_t WiegandPort::ticks_to_ns(uint32_t ticks) const
+{
+    // Whole and fractional ns per tick separately, so a ms-long tick cannot overflow.
+    const uint64_t ns = static_cast<uint64_t>(ticks) * (ns_per_tick_q16_ >> 16) +
+                        ((static_cast<uint64_t>(ticks) * (ns_per_tick_q16_ & 0xFFFFu)) >> 16);
+    return (ns > UINT32_MAX) ? UINT32_MAX : static_cast<uint32_t>(ns);
+}
+
+void WiegandPort::set_compliance(const ComplianceLimits &limits)
+{
+    compliance_ns_ = limits;
+    apply_compliance();
+}
+
+void WiegandPort::apply_compliance()
+{
+    ComplianceLimits ticks = compliance_ns_;
+    ticks.pulse_min = ns_to_ticks(compliance_ns_.pulse_min);
+    ticks.pulse_max = ns_to_ticks(compliance_ns_.pulse_max);
+    ticks.gap_min = ns_to_ticks(compliance_ns_.gap_min);
+    ticks.gap_max = ns_to_ticks(compliance_ns_.gap_max);
+    decoder_.set_limits(ticks);
+}
+
+TimingSummary WiegandPort::timing_ns(const TimingStats &stats) const
+{
+    return TimingSummary{ticks_to_ns(stats.min_or_zero()), ticks_to_ns(stats.avg()),
+                         ticks_to_ns(stats.max_or_zero())};
+}
+
+void WiegandPort::start_timebase(uint64_t now_us)
+{
+    timebase_start_us_ = now_us;
+}
+
+uint64_t WiegandPort::unwrap_ticks(uint32_t ticks, uint64_t now_us) const
+{
+    // The PIO count wraps every 2^30 ticks (about 18 minutes at 1 MHz), which a long idle
+    // spell can hide, so place it against the system timer instead of tracking wraps: the
+    // edge is the latest tick count at or before now that matches the low 30 bits. The
+    // slack absorbs the few microseconds between the anchor and the SMs starting.
+    constexpr uint64_t kWrap = 1ull << 30;
+    constexpr uint64_t kSlack = 1ull << 20;
+    const uint64_t elapsed_us = now_us - timebase_start_us_;
+    const uint64_t now_ticks = span_ticks(elapsed_us) + kSlack;
+    const uint64_t behind = (now_ticks - ticks) & (kWrap - 1);
+    return (now_ticks >= behind) ? now_ticks - behind : ticks;
+}
+
+uint64_t WiegandPort::ticks_to_us(uint64_t ticks) const
+{
+    return timebase_start_us_ + span_us(ticks);
+}
+
+uint64_t WiegandPort::span_us(uint64_t ticks) const
+{
+    // ticks * cycles per tick / clk_sys, from the divider the SM really has rather than a
+    // rounded rate, which would drift from the anchor by a fraction of a ms an hour. Cycles
+    // are 24.8 fixed point; whole seconds come off first so years of ticks stay in 64 bits.
+    const uint64_t cycles_q8 = ticks * tick_cycles_q8_;
+    const uint64_t second_q8 = static_cast<uint64_t>(sys_hz_) * 256u;
+    return (cycles_q8 / second_q8) * 1000000u +
+           ((cycles_q8 % second_q8) * 1000000u + second_q8 / 2) / second_q8;
+}
+
+uint64_t WiegandPort::span_ticks(uint64_t us) const
+{
+    const uint64_t second_q8 = static_cast<uint64_t>(sys_hz_) * 256u;
+    const uint64_t cycles_q8 =
+        (us / 1000000u) * second_q8 + (us % 1000000u) * second_q8 / 1000000u;
+    return (cycles_q8 + tick_cycles_q8_ / 2) / tick_cycles_q8_;
+}
+
+WiegandPort::CaptureStats WiegandPort::capture_stats() const
+{
+    CaptureStats stats{};
+    stats.mode = capture_mode_;
+    noInterrupts();
+    stats.irqs = irq_count_;
+    stats.irq_edges = irq_edge_count_;
+    stats.dropped = dropped_edge_count_;
+    interrupts();
+    stats.glitches = decoder_.glitch_count();
+    stats.dma_edges = dma_edge_count_;
+    stats.blocks = blocks_held_;
+    stats.blocks_peak = blocks_peak_;
+    stats.records_peak = records_peak_;
+    stats.alloc_failures = alloc_failures_;
+    return stats;
+}
+
+bool WiegandPort::start_dma()
+{
+    dma_data_chan_ = dma_claim_unused_channel(false);
+    dma_ctrl_chan_ = dma_claim_unused_channel(false);
+    // The ring's blocks are held for as long as DMA runs; the ones the IRQ path had go back
+    // first, so they count toward it.
+    if (dma_data_chan_ < 0 || dma_ctrl_chan_ < 0 ||
+        g_edge_pool.free_blocks() + blocks_held_ < kDmaSlots)
+    {
+        stop_dma();
+        return false;
+    }
+    release_all_blocks();
+    for (uint32_t slot = 0; slot < kDmaSlots; ++slot)
+    {
+        blocks_[slot] = g_edge_pool.alloc();
+    }
+    blocks_held_ = kDmaSlots;
+    if (blocks_held_ > blocks_peak_)
+    {
+        blocks_peak_ = blocks_held_;
+    }
+    slot_mask_ = kDmaSlots - 1;
+    const uint data_chan = static_cast<uint>(dma_data_chan_);
+    const uint ctrl_chan = static_cast<uint>(dma_ctrl_chan_);
+
+    // Data channel: one word per FIFO DREQ into a block, then hand off to the control channel.
+    dma_channel_config data_cfg = dma_channel_get_default_config(data_chan);
+    channel_config_set_transfer_data_size(&data_cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&data_cfg, false);
+    channel_config_set_write_increment(&data_cfg, true);
+    channel_config_set_dreq(&data_cfg, pio_get_dreq(pio_, sm_, false));
+    channel_config_set_chain_to(&data_cfg, ctrl_chan);
+    dma_channel_configure(data_chan, &data_cfg, blocks_[0], &pio_->rxf[sm_], kBlockWords, false);
+
+    // Control channel: point the data channel (trigger alias) at the next block in blocks_,
+    // wrapping at kDmaSlots.
+    dma_channel_config ctrl_cfg = dma_channel_get_default_config(ctrl_chan);
+    channel_config_set_transfer_data_size(&ctrl_cfg, DMA_SIZE_32);
+    channel_config_set_read_increment(&ctrl_cfg, true);
+    channel_config_set_write_increment(&ctrl_cfg, false);
+    channel_config_set_ring(&ctrl_cfg, false, kDmaRingBits);
+    dma_channel_configure(ctrl_chan, &ctrl_cfg, &dma_channel_hw_addr(data_chan)->al2_write_addr_trig,
+                          &blocks_[1], 1, false);
+
+    // The data channel starts at the top of blocks_[0], so the sequence numbers restart at 0.
+    // Each finished block raises DMA_IRQ_1 (see handle_dma_irq()), so poll_dma() can tell
+    // a lap of the ring from a short advance.
+    dma_blocks_done_ = 0;
+    dma_irqn_acknowledge_channel(kDmaIrqIndex, data_chan);
+    dma_irqn_set_channel_enabled(kDmaIrqIndex, data_chan, true);
+    head_ = 0;
+    tail_ = 0;
+    open_start_ = 0;
+    sealed_rd_ = sealed_wr_;
+    loss_rd_ = loss_wr_;
+    start_pending_ = false;
+    decoder_.reset();
+    dma_channel_start(data_chan);
+    return true;
+}
+
+void WiegandPort::stop_dma()
+{
+    if (dma_ctrl_chan_ >= 0)
+    {
+        dma_channel_abort(static_cast<uint>(dma_ctrl_chan_));
+    }
+    if (dma_data_chan_ >= 0)
+    {
+        // Break the chain before aborting so the abort cannot re-arm the control channel.
+        const uint data_chan = static_cast<uint>(dma_data_chan_);
+        dma_irqn_set_channel_enabled(kDmaIrqIndex, data_chan, false);
+        dma_channel_config data_cfg = dma_channel_get_default_config(data_chan);
+        channel_config_set_chain_to(&data_cfg, data_chan);
+        channel_config_set_enable(&data_cfg, false);
+        dma_channel_set_config(data_chan, &data_cfg, false);
+        dma_channel_abort(data_chan);
+        dma_channel_unclaim(data_chan);
+        dma_data_chan_ = -1;
+    }
+    if (dma_ctrl_chan_ >= 0)
+    {
+        dma_channel_unclaim(static_cast<uint>(dma_ctrl_chan_));
+        dma_ctrl_chan_ = -1;
+    }
+    if (slot_mask_ != kBlockSlots - 1)
+    {
+        // The ring's blocks; whatever was in them is dropped by the caller.
+        release_all_blocks();
+        slot_mask_ = kBlockSlots - 1;
+    }
+}
+
+void WiegandPort::handle_dma_irq()
+{
+    if (dma_data_chan_ < 0)
+    {
+        return;
+    }
+    const uint data_chan = static_cast<uint>(dma_data_chan_);
+    if (dma_irqn_get_channel_status(kDmaIrqIndex, data_chan))
+    {
+        dma_irqn_acknowledge_channel(kDmaIrqIndex, data_chan);
+        dma_blocks_done_ = dma_blocks_done_ + 1;
+    }
+}
+
+uint32_t WiegandPort::dma_write_seq() const
+{
+    // The control channel's read address is the table entry after the block the data channel
+    // is filling, and the data channel's count is what is left of that block. A count of 0
+    // or a read address that moved means the hand-over to the next block is under way (a few
+    // cycles), so read again.
+    const dma_channel_hw_t *data_hw = dma_channel_hw_addr(static_cast<uint>(dma_data_chan_));
+    const dma_channel_hw_t *ctrl_hw = dma_channel_hw_addr(static_cast<uint>(dma_ctrl_chan_));
+    uint32_t next_entry;
+    uint32_t left;
+    do
+    {
+        next_entry = ctrl_hw->read_addr;
+        left = data_hw->transfer_count;
+    } while (left == 0 || ctrl_hw->read_addr != next_entry);
+    const uint32_t table_addr = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(blocks_));
+    const uint32_t next_slot = ((next_entry - table_addr) / sizeof(uint32_t)) & (kDmaSlots - 1);
+    const uint32_t slot = (next_slot - 1) & (kDmaSlots - 1);
+    // The slot only gives the block modulo the ring; the IRQ's count of finished blocks gives
+    // the laps. The IRQ may not have run for the latest hand-over or two, which the slot
+    // settles: block n always fills slot n % kDmaSlots.
+    const uint32_t done = dma_blocks_done_;
+    const uint32_t block = done + ((slot - done) & (kDmaSlots - 1));
+    return block * kBlockWords + kBlockWords - left;
+}
+
+uint32_t WiegandPort::copy_records(uint32_t seq, uint32_t count, uint32_t *out)
+{
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        out[i] = record(seq + i);
+    }
+    if (dma_data_chan_ < 0)
+    {
+        return 0; // the ISR never writes over records before tail_
+    }
+    // The data channel kept writing while we copied; whatever it has reached since is not
+    // what was captured there, so count back from where it is now.
+    const int32_t overwritten =
+        static_cast<int32_t>(dma_write_seq() - ring_capacity() - seq);
+    if (overwritten <= 0)
+    {
+        return 0;
+    }
+    return (static_cast<uint32_t>(overwritten) < count) ? static_cast<uint32_t>(overwritten)
+                                                        : count;
+}
+
+void WiegandPort::poll_dma()
+{
+    // The head only moves forward, and dma_write_seq() counts every record since start_dma(),
+    // however long the main loop went without polling, so a lap shows as one.
+    const uint32_t written = dma_write_seq();
+    const uint32_t capacity = ring_capacity();
+    const uint32_t advanced = written - head_;
+    if (advanced == 0)
+    {
+        return;
+    }
+    const uint32_t now = time_us_32();
+    close_frame_if_quiet(now);
+    head_ = written;
+    dma_edge_count_ += advanced;
+    if (head_ - tail_ > capacity)
+    {
+        // The DMA lapped unprocessed records; they are gone.
+        const uint32_t new_tail = head_ - capacity;
+        dropped_edge_count_ += new_tail - tail_;
+        tail_ = new_tail;
+        if (static_cast<int32_t>(open_start_ - new_tail) < 0)
+        {
+            open_start_ = new_tail;
+        }
+    }
+    if (head_ - tail_ > records_peak_)
+    {
+        records_peak_ = head_ - tail_;
+    }
+    note_activity(now);
+}
+
 bool WiegandPort::tx_timer_trampoline(repeating_timer_t *rt)
 {
     return static_cast<WiegandPort *>(rt->user_data)->handle_tx_timer();
@@ -394,7 +1523,7 @@ void WiegandPort::drive_bit(bool bit_is_one)
 bool WiegandPort::transmit(const uint8_t *data, size_t data_bytes, uint32_t bit_count,
                            uint32_t bit_time_us, uint32_t interbit_time_us)
 {
-    if (!data || bit_count == 0 || bit_count > kMaxBits)
+    if (!tx_allowed() || !data || bit_count == 0 || bit_count > kMaxBits)
     {
         return false;
     }
@@ -447,16 +1576,7 @@ bool WiegandPort::transmit(const uint8_t *data, size_t data_bytes, uint32_t bit_
     }
 
     // Use per-port color for TX logs on the terminal.
-    uint16_t color = TFT_GREEN;
-    if (port_id_ == 1)
-    {
-        color = TFT_MAGENTA; // high contrast on black
-    }
-    else if (port_id_ == 2)
-    {
-        color = TFT_CYAN;
-    }
-    terminalSetColor(color);
+    terminalSetColor(port_color(port_id_));
     terminalAddLine(summary);
     terminalAddIndentedLine(hexline);
     terminalResetColor();
@@ -1,26 +1,303 @@
 #pragma once
 
 #include <Arduino.h>
+#include <hardware/dma.h>
 #include <hardware/pio.h>
 #include <pico/time.h>
 
+#include "edge_pool.h"
+#include "edge_trigger.h"
+#include "wiegand_decoder.h"
+#include "wiegand_format.h"
+#include "wiegand_frame.h"
 #include "wiegand_rx2.h"
+#include "wiegand_rx_log.h"
+
+// Build with -D WIEGAND_DUAL_CORE=1 to run RX capture and decoding on core1 and leave
+// core0 to the serial commands, terminal and TX.
+#ifndef WIEGAND_DUAL_CORE
+#define WIEGAND_DUAL_CORE 0
+#endif
 
 class WiegandPort
 {
 public:
+    // How edge records get from the SM's RX FIFO into the port's pool blocks.
+    enum class CaptureMode
+    {
+        Irq, // FIFO-not-empty interrupt drains the FIFO word by word
+        Dma, // chained DMA channels stream the FIFO into a fixed ring of blocks
+    };
+
+    // Capture path counters. In DMA mode every edge record counted in dma_edges
+    // is one that did not cost a FIFO interrupt.
+    struct CaptureStats
+    {
+        CaptureMode mode;
+        uint32_t irqs;      // FIFO interrupts serviced
+        uint32_t irq_edges; // edge records drained by the interrupt handler
+        uint32_t dma_edges; // edge records moved by DMA without CPU involvement
+        uint32_t dropped;   // edge records lost: blocks full of unprocessed frames, or none free
+        uint32_t glitches;  // level changes rejected by the wiegand_rx2 glitch filter
+        uint32_t blocks;         // g_edge_pool blocks held now
+        uint32_t blocks_peak;    // most blocks held at once
+        uint32_t records_peak;   // most edge records captured but not yet decoded at once
+        uint32_t alloc_failures; // times a record was dropped because the pool was empty
+    };
+
+    // What the port is wired for. Only ports with RX run a state machine, hold a share of
+    // their PIO's instruction memory and have their FIFO interrupt source enabled.
+    enum class Role
+    {
+        RxTx,     // loopback tester: transmit and listen on the same port (the default)
+        Rx,       // listen only
+        Tx,       // transmit only
+        Disabled, // unwired: no SM, no interrupt, no timer
+    };
+
+    // One port per state machine: up to four on each PIO block.
+    static constexpr size_t kMaxPorts = NUM_PIOS * NUM_PIO_STATE_MACHINES;
+
     WiegandPort(PIO pio, uint sm, uint irq_index, uint pin_base_d0, uint port_id, uint tx_pin_d0,
                 uint tx_pin_d1, uint led_pin);
 
-    void init(uint program_offset, float clk_div);
+    // tick_ns: RX timestamp resolution, see set_tick_ns(). Returns false if the port's role
+    // has RX but its program does not fit in the PIO block (TX still works).
+    bool init(uint32_t tick_ns);
+
+    // Change the role at run time. Dropping RX stops the SM, masks its interrupt source,
+    // releases the DMA channels and the program (when no other port on the block uses it)
+    // and discards anything captured; dropping TX ends a transmission in progress. Fails,
+    // leaving the role as it was, if RX is asked for and the program does not fit.
+    bool set_role(Role role);
+
+    Role role() const
+    {
+        return role_;
+    }
+
+    // RX SM loaded and running (RX role and init() succeeded).
+    bool rx_active() const
+    {
+        return program_offset_ >= 0;
+    }
+
+    bool tx_allowed() const
+    {
+        return role_ == Role::RxTx || role_ == Role::Tx;
+    }
+
     void handle_irq();
+    // DMA_IRQ_1 (kDmaIrqIndex) handler work: count the block this port's DMA ring finished.
+    void handle_dma_irq();
+    static constexpr uint kDmaIrqIndex = 1;
     void reset_buffer();
     uint32_t buffer_level() const;
-    bool message_ready(uint32_t quiet_ms) const;
-    bool process(uint32_t quiet_ms);
+    bool message_ready() const;
+    // RX side: capture, decode and queue finished frames on g_rx_queue.
+    bool process();
+    // Main-loop side: show a frame from g_rx_queue on the terminal, log it, blink the LED.
+    void report(const RxMessage &msg);
     void tick();
     bool transmit(const uint8_t *data, size_t data_bytes, uint32_t bit_count, uint32_t bit_time_us,
                   uint32_t interbit_time_us);
+    bool set_capture_mode(CaptureMode mode);
+    CaptureStats capture_stats() const;
+    // A frame ends once its port has seen no edge for this long.
+    void set_frame_quiet_us(uint32_t quiet_us)
+    {
+        quiet_us_ = quiet_us;
+    }
+
+    uint32_t frame_quiet_us() const
+    {
+        return quiet_us_;
+    }
+
+    // Split frames that follow each other closer than the quiet time: an edge (edges mode) or
+    // pulse (pulses mode) that comes at least gap_ticks RX ticks after the previous one starts
+    // a new RxMessage. 0 turns it off; pulses mode can only see gaps below 2^15 ticks.
+    void set_split_gap_ticks(uint32_t gap_ticks)
+    {
+        split_gap_ticks_ = gap_ticks;
+    }
+
+    uint32_t split_gap_ticks() const
+    {
+        return split_gap_ticks_;
+    }
+
+    // End-of-frame alarms: each port arms one from its capture path when a frame starts, and
+    // it fires (on pool's core) quiet_us after the last edge, waking the RX loop with __sev()
+    // so the frame is published without waiting for a poll. Call from the core that takes
+    // the capture IRQ, before enabling it. Without a pool, process() still finds the gap.
+    static void use_alarm_pool(alarm_pool_t *pool);
+
+    // Switch the SM to another capture program. Fails (leaving the port as it was) if the
+    // program does not fit in the port's PIO block. Without RX it only records the choice.
+    bool set_rx_program(WiegandRxProgram program);
+
+    WiegandRxProgram rx_program() const
+    {
+        return rx_program_;
+    }
+
+    // RX timestamp resolution. The SM clock divider is worked out from clk_sys to give the
+    // nearest tick the hardware can do, no shorter than kWiegandRx2CyclesPerTick system
+    // clocks. Shorter ticks shorten the counter span (2^30 ticks for edges, 2^15 for pulse
+    // widths and gaps in pulses mode) and the longest glitch filter. Restarts the SM, so the
+    // port leaves the shared timebase until the next sync_rx_timebase().
+    // Longer ticks than max_tick_ns() (the largest divider, about 3.9 ms at 150 MHz) clamp.
+    void set_tick_ns(uint32_t tick_ns);
+    static uint32_t max_tick_ns();
+
+    // Actual tick length, rounded to whole ns.
+    uint32_t tick_ns() const
+    {
+        return static_cast<uint32_t>((ns_per_tick_q16_ + 0x8000u) >> 16);
+    }
+
+    float clk_div() const
+    {
+        return clk_div_;
+    }
+
+    // How long the current RX program's counter runs before it wraps: the edge stamps for
+    // wiegand_rx2, the width and gap fields for wiegand_rx_pulse (bits mode has no stamps).
+    uint64_t counter_span_us() const;
+
+    // wiegand_rx2 glitch filter: ignore level changes that do not last this long (rounded to
+    // whole ticks, at most kWiegandRx2MaxFilterSamples - 1; 0 = off). Takes effect at once and
+    // survives program switches; the pulse and bit programs do not filter.
+    void set_glitch_filter_us(uint32_t us);
+    uint32_t glitch_filter_us() const;
+
+    // Raw mode: every wiegand_rx2 record goes to the host as-is through g_raw_queue (see
+    // raw_stream.h) instead of to the decoder, so no frames are reported. Edges program only;
+    // switching program turns it off. Anything captured but not decoded is dropped.
+    bool set_raw_stream(bool on);
+
+    bool raw_stream() const
+    {
+        return raw_stream_;
+    }
+
+    // Pre-trigger capture on the edges program (see EdgeTrigger); pulse_min/pulse_max are
+    // given in ns. Fails if the port is not receiving with wiegand_rx2 or the pool cannot
+    // lend the ring. Switching program turns it off.
+    bool arm_trigger(EdgeTrigger::Condition cond, uint32_t post);
+    void disarm_trigger();
+
+    const EdgeTrigger &trigger() const
+    {
+        return trigger_;
+    }
+
+    // Frames with each kind of fault (WiegandDecoder::kError*) since boot, plus stuck-line
+    // episodes: a line seen low on every check for kStuckLineUs with no capture activity, which would
+    // otherwise just look like silence. stuck_lines() is the lines stuck now (bit 0 D0, bit 1 D1).
+    static constexpr uint32_t kStuckLineUs = 100000;
+
+    struct ErrorCounts
+    {
+        uint32_t overlap;
+        uint32_t runt;
+        uint32_t truncated;
+        uint32_t line_low;
+        uint32_t stuck;
+    };
+
+    ErrorCounts error_counts() const
+    {
+        return error_counts_;
+    }
+
+    uint32_t stuck_lines() const
+    {
+        return stuck_lines_;
+    }
+
+    // Timing compliance: limits (in ns) every frame is checked against edge by edge while
+    // enabled, and per-rule totals since boot or the last clear. The bits program carries no
+    // timing, so its frames are not checked.
+    struct ComplianceTotals
+    {
+        uint32_t frames; // frames checked
+        uint32_t failed; // frames that broke any rule
+        uint32_t violations[kComplianceRules];
+    };
+
+    void set_compliance(const ComplianceLimits &limits);
+
+    const ComplianceLimits &compliance() const
+    {
+        return compliance_ns_;
+    }
+
+    ComplianceTotals compliance_totals() const
+    {
+        return compliance_totals_;
+    }
+
+    void clear_compliance_totals()
+    {
+        compliance_totals_ = ComplianceTotals{};
+    }
+
+    // Timing histograms across frames, in ticks of tick_ns() (see TimingHistogram).
+    const TimingHistogram &pulse_histogram(int line) const
+    {
+        return decoder_.pulse_histogram(line);
+    }
+
+    const TimingHistogram &gap_histogram(int line) const
+    {
+        return decoder_.gap_histogram(line);
+    }
+
+    void clear_histograms()
+    {
+        decoder_.clear_histograms();
+    }
+
+    // Card format auto-detection (see WiegandFormatCache); reset forgets the learned format.
+    const WiegandFormatCache &format_cache() const
+    {
+        return format_cache_;
+    }
+
+    void reset_format_cache()
+    {
+        format_cache_.reset();
+    }
+
+    // Restart every port's RX SM from the top of its program and enable them all on the same
+    // PIO clock cycle, so their counters (and RxMessage start/end ticks) agree to the tick.
+    // Anything captured but not yet decoded is dropped.
+    static void sync_rx_timebase(WiegandPort *ports, size_t count);
+
+    // False once the port's SM has been restarted on its own (e.g. by set_rx_program).
+    bool timebase_synced() const
+    {
+        return timebase_synced_;
+    }
+
+    // Benchmark support: drive what the port's PIO sees on D0/D1 through the GPIO input
+    // override, without touching the lines, and hand them back afterwards.
+    void force_rx_lines(bool d0_low, bool d1_low);
+    void release_rx_lines();
+    // True if the SM had to wait for RX FIFO space (so sampled late) since the last call.
+    bool take_rx_stall();
+
+    CaptureMode capture_mode() const
+    {
+        return capture_mode_;
+    }
+
+    PIO pio() const
+    {
+        return pio_;
+    }
 
     uint irq_index() const
     {
@@ -43,10 +320,26 @@ public:
     }
 
 private:
-    // Edge records per message: two edges per bit (fall+rise). Support up to 512 bits.
-    static constexpr uint32_t kBufferCapacity = 1024;
-    static constexpr uint32_t kTxBufferBytes = 32;  // 256 bits max
-    static constexpr uint32_t kMaxBits = kTxBufferBytes * 8;
+    // Edge records in flight live in blocks borrowed from g_edge_pool, found by free-running
+    // sequence number: record seq is word seq % kBlockWords of slot (seq / kBlockWords) &
+    // slot_mask_. IRQ capture borrows a block when it first writes to a slot, up to
+    // kBlockSlots of them (two edges per bit, so a 1024-bit frame if the decoder stalls), and
+    // returns each once decoded. DMA capture holds kDmaSlots blocks while it runs.
+    static constexpr uint32_t kBlockWords = EdgePool::kBlockWords;
+    static constexpr uint32_t kBlockSlots = 32;
+    static constexpr uint32_t kDmaSlots = 16;
+    // The DMA control channel walks blocks_[0..kDmaSlots) as a read ring of 2^n bytes.
+    static constexpr uint kDmaRingBits = 6;
+    static_assert((kBlockSlots & (kBlockSlots - 1)) == 0 && kDmaSlots <= kBlockSlots,
+                  "slot index uses a mask");
+    static_assert(kDmaSlots * sizeof(uint32_t) == (1u << kDmaRingBits), "DMA table ring size");
+    // Frames closed by the capture path but not yet consumed by process().
+    static constexpr uint8_t kSealedFrames = 4;
+    // Overflows the capture ISR has had and the raw stream has not reported yet.
+    static constexpr uint8_t kLossMarks = 8;
+    static constexpr uint32_t kTxBufferBytes = kWiegandMaxFrameBytes;
+    static constexpr uint32_t kMaxBits = kWiegandMaxFrameBits;
+    static_assert(WiegandDecoder::kMaxBits <= kMaxBits, "decoded frames must fit the hex buffers");
 
     enum class TxState { Idle, Pulse, InterBit };
 
@@ -55,6 +348,61 @@ private:
     void drive_idle();
     void drive_bit(bool bit_is_one);
     void trigger_led(uint32_t duration_ms = 500);
+    bool start_dma();
+    void stop_dma();
+    void poll_dma();
+    uint32_t dma_write_seq() const;
+    uint32_t copy_records(uint32_t seq, uint32_t count, uint32_t *out);
+    void feed_records(uint32_t seq, const uint32_t *words, uint32_t count);
+    void close_frame_if_quiet(uint32_t now_us);
+    bool seal_open_frame();
+    void note_activity(uint32_t now_us);
+    static int64_t eof_alarm_trampoline(alarm_id_t id, void *user_data);
+    int64_t handle_eof_alarm();
+    void feed_decoder(uint32_t end);
+    bool store_record(uint32_t word);
+    void note_dropped_record();
+    void release_slot(uint32_t slot);
+    void advance_tail(uint32_t end);
+    void release_all_blocks();
+
+    volatile uint32_t &record(uint32_t seq)
+    {
+        return blocks_[(seq / kBlockWords) & slot_mask_][seq & (kBlockWords - 1)];
+    }
+
+    uint32_t ring_capacity() const
+    {
+        return (slot_mask_ + 1) * kBlockWords;
+    }
+    void publish_frame();
+    void stream_raw();
+
+    bool start_rx();
+    void stop_rx();
+    void stop_tx();
+    void rewind_rx();
+    void start_timebase(uint64_t now_us);
+    uint64_t unwrap_ticks(uint32_t ticks, uint64_t now_us) const;
+    uint64_t ticks_to_us(uint64_t ticks) const;
+    uint64_t span_us(uint64_t ticks) const;  // a tick count as us, rounded
+    uint64_t span_ticks(uint64_t us) const;  // and back
+    uint32_t ticks_to_ns(uint32_t ticks) const;
+    uint32_t ns_to_ticks(uint32_t ns) const;
+    TimingSummary timing_ns(const TimingStats &stats) const;
+    void apply_compliance();
+    void check_stuck_lines();
+    void apply_tick_ns(uint32_t tick_ns);
+    void apply_glitch_filter();
+    bool bit_frame_quiet();
+    void flush_bit_frame();
+
+    // A frame needs at least one complete pulse: two edge records or one pulse record. A
+    // bit-assembler frame always ends with a partial word and a bit count.
+    uint32_t frame_min_records() const
+    {
+        return (rx_program_ == WiegandRxProgram::Pulses) ? 1 : 2;
+    }
 
     PIO pio_;
     uint sm_;
@@ -64,9 +412,80 @@ private:
     uint tx_pin_d0_;
     uint tx_pin_d1_;
     uint led_pin_;
-    volatile uint32_t buffer_[kBufferCapacity];
-    volatile uint32_t count_;
-    volatile uint32_t last_transition_ms_;
+    Role role_;
+    float clk_div_;
+    uint64_t ns_per_tick_q16_; // tick length in ns, 16.16 fixed point (ticks reach ~4 ms)
+    WiegandRxProgram rx_program_;
+    int program_offset_;
+    uint32_t filter_us_;      // glitch filter as asked for; filter_samples_ follows the tick
+    uint32_t filter_samples_; // wiegand_rx2 samples a new level must hold for (1 = no filter)
+    bool timebase_synced_;
+    // System timer time at which the SM's counter started from 0, and the tick exactly:
+    // clk_sys cycles per tick in 24.8 fixed point (divider times loop cycles) and clk_sys.
+    uint64_t timebase_start_us_;
+    uint32_t tick_cycles_q8_;
+    uint32_t sys_hz_;
+    // Edge ring. The capture path (ISR or DMA poll) appends at head_; process() consumes
+    // whole frames from tail_. open_start_ is where the frame still being received begins,
+    // and sealed_ends_ queues the end sequence of frames closed at a quiet gap. Blocks before
+    // released_seq_ have gone back to the pool. blocks_ doubles as the DMA control table.
+    alignas(1u << kDmaRingBits) volatile uint32_t *blocks_[kBlockSlots];
+    uint32_t slot_mask_;
+    uint32_t released_seq_;
+    volatile uint32_t blocks_held_;
+    uint32_t blocks_peak_;
+    uint32_t records_peak_;
+    volatile uint32_t alloc_failures_;
+    volatile uint32_t head_;
+    volatile uint32_t tail_;
+    volatile uint32_t open_start_;
+    uint32_t sealed_ends_[kSealedFrames];
+    volatile uint8_t sealed_wr_;
+    volatile uint8_t sealed_rd_;
+    volatile uint32_t quiet_us_;
+    volatile uint32_t split_gap_ticks_;
+    volatile uint32_t last_edge_us_;  // time_us_32() of the latest capture activity
+    volatile alarm_id_t eof_alarm_;   // pending end-of-frame alarm, 0 if none
+    static alarm_pool_t *eof_pool_;
+    WiegandDecoder decoder_; // fed from tail_ as edges arrive; holds the frame being received
+    EdgeTrigger trigger_;    // sees the same records, edges mode only
+    WiegandFormatCache format_cache_; // the format this port's frames decode as
+    ComplianceLimits compliance_ns_;     // the decoder has them in ticks
+    ComplianceTotals compliance_totals_;
+    ErrorCounts error_counts_;
+    volatile uint32_t stuck_lines_;
+    // Lines seen low at the last check_stuck_lines(), and since when (restarted by activity).
+    uint32_t low_lines_;
+    uint32_t low_since_us_[2];
+    bool raw_stream_;        // records bypass the decoder for g_raw_queue
+    // wiegand_rx2 pushes the initial levels as its first word after rewind_rx(); that record's
+    // sequence number, while it has not reached the decoder (a stamp of 0 is a real edge too).
+    uint32_t start_seq_;
+    bool start_pending_;
+    uint32_t raw_seq_;       // stream sequence number of the next record, lost ones included
+    uint32_t raw_dropped_;   // dropped_edge_count_ already reported in the stream (DMA laps)
+    // The ISR drops the newest records when it has no room, so each overflow is reported at
+    // the sequence number head_ had then: seq and count of up to kLossMarks of them (a later
+    // one is added to the newest when all are pending), written by the ISR.
+    struct LossMark
+    {
+        uint32_t seq;
+        uint32_t count;
+    };
+    LossMark loss_marks_[kLossMarks];
+    volatile uint8_t loss_wr_;
+    uint8_t loss_rd_;
+    bool bit_frame_open_;    // wiegand_rx_bits has counted bits the CPU has not flushed yet
+
+    // Capture path state. In DMA mode head_ follows the data channel's write address.
+    CaptureMode capture_mode_;
+    int dma_data_chan_;
+    int dma_ctrl_chan_;
+    volatile uint32_t dma_blocks_done_; // blocks finished since start_dma(), from the DMA IRQ
+    volatile uint32_t irq_count_;
+    volatile uint32_t irq_edge_count_;
+    uint32_t dma_edge_count_;
+    volatile uint32_t dropped_edge_count_;
 
     // Transmit state
     repeating_timer_t tx_timer_;
@@ -1,12 +1,99 @@
-#include "wiegand_rx2.pio.h"
+#include "wiegand_rx2.h"
+#include "wiegand_rx_bits.pio.h"
+#include "wiegand_rx_pulse.pio.h"
 #include <hardware/pio.h>
 
-// Use the pioasm-generated program (wiegand_rx_program) and default config helper.
+// Use the pioasm-generated programs and default config helpers.
 // This file only provides a thin init wrapper that sets pins and clock divider.
 
-void wiegand_rx2_program_init(PIO pio, uint sm, uint offset, uint pin, float clk_div)
+namespace {
+
+constexpr uint kProgramCount = 3;
+
+struct LoadedProgram
+{
+    uint refs;
+    uint offset;
+};
+
+LoadedProgram g_loaded[NUM_PIOS][kProgramCount] = {};
+
+const pio_program_t *program_for(WiegandRxProgram program)
+{
+    switch (program)
+    {
+    case WiegandRxProgram::Pulses:
+        return &wiegand_rx_pulse_program;
+    case WiegandRxProgram::Bits:
+        return &wiegand_rx_bits_program;
+    case WiegandRxProgram::Edges:
+    default:
+        return &wiegand_rx2_program;
+    }
+}
+
+} // namespace
+
+int wiegand_rx_program_acquire(PIO pio, WiegandRxProgram program)
+{
+    LoadedProgram &slot = g_loaded[pio_get_index(pio)][static_cast<uint>(program)];
+    if (slot.refs == 0)
+    {
+        const pio_program_t *code = program_for(program);
+        if (!pio_can_add_program(pio, code))
+        {
+            return -1;
+        }
+        slot.offset = static_cast<uint>(pio_add_program(pio, code));
+    }
+    slot.refs += 1;
+    return static_cast<int>(slot.offset);
+}
+
+void wiegand_rx_program_release(PIO pio, WiegandRxProgram program)
+{
+    LoadedProgram &slot = g_loaded[pio_get_index(pio)][static_cast<uint>(program)];
+    if (slot.refs == 0)
+    {
+        return;
+    }
+    slot.refs -= 1;
+    if (slot.refs == 0)
+    {
+        pio_remove_program(pio, program_for(program), slot.offset);
+    }
+}
+
+uint wiegand_rx_program_entry(WiegandRxProgram program, uint offset)
+{
+    return (program == WiegandRxProgram::Edges) ? offset + wiegand_rx2_offset_start : offset;
+}
+
+void wiegand_rx2_set_filter(PIO pio, uint sm, uint filter_samples)
+{
+    // The filter count is the OSR shift count against the pull threshold (0 encodes 32).
+    hw_write_masked(&pio->sm[sm].shiftctrl,
+                    (filter_samples % 32) << PIO_SM0_SHIFTCTRL_PULL_THRESH_LSB,
+                    PIO_SM0_SHIFTCTRL_PULL_THRESH_BITS);
+}
+
+void wiegand_rx2_program_init(PIO pio, uint sm, uint offset, uint pin, float clk_div,
+                              WiegandRxProgram program, uint filter_samples)
 {
-    pio_sm_config c = wiegand_rx2_program_get_default_config(offset);
+    pio_sm_config c;
+    switch (program)
+    {
+    case WiegandRxProgram::Pulses:
+        c = wiegand_rx_pulse_program_get_default_config(offset);
+        break;
+    case WiegandRxProgram::Bits:
+        c = wiegand_rx_bits_program_get_default_config(offset);
+        break;
+    case WiegandRxProgram::Edges:
+    default:
+        c = wiegand_rx2_program_get_default_config(offset);
+        break;
+    }
     sm_config_set_in_pins(&c, pin);  // reads the configured GPIO as bit0
     sm_config_set_clkdiv(&c, clk_div);
 
@@ -14,9 +101,38 @@ void wiegand_rx2_program_init(PIO pio, uint sm, uint offset, uint pin, float clk
     pio_gpio_init(pio, pin);
     pio_gpio_init(pio, pin + 1);
     pio_sm_set_consecutive_pindirs(pio, sm, pin, 2, false);
-    sm_config_set_in_shift(&c,
-                           /* shift_right = */ false,  // push towards MSB, new bits at LSB
-                           /* autopush    = */ false,
-                           /* push_thresh = */ 32);
-    pio_sm_init(pio, sm, offset, &c);
+    if (program == WiegandRxProgram::Pulses)
+    {
+        // out y, 2 takes the line bits from the bottom of ~pins; the 2 + 15 + 15 bit
+        // word is pushed automatically once the rise stamp is shifted in.
+        sm_config_set_out_shift(&c, /* shift_right = */ true, /* autopull = */ false, 32);
+        sm_config_set_in_shift(&c, /* shift_right = */ false, /* autopush = */ true, 32);
+    }
+    else if (program == WiegandRxProgram::Bits)
+    {
+        // mov x, pins must see D0 alone; D1 is tested with jmp pin / wait jmppin.
+        sm_config_set_in_pin_count(&c, 1);
+        sm_config_set_jmp_pin(&c, pin + 1);
+        sm_config_set_in_shift(&c, /* shift_right = */ false, /* autopush = */ true, 32);
+    }
+    else
+    {
+        // mov x, pins must see D0/D1 only; the pull threshold is the glitch filter length.
+        sm_config_set_in_pin_count(&c, 2);
+        sm_config_set_in_shift(&c,
+                               /* shift_right = */ false,  // push towards MSB, new bits at LSB
+                               /* autopush    = */ false,
+                               /* push_thresh = */ 32);
+        sm_config_set_out_shift(&c, /* shift_right = */ true, /* autopull = */ false,
+                                filter_samples);
+    }
+    pio_sm_init(pio, sm, wiegand_rx_program_entry(program, offset), &c);
+    if (program == WiegandRxProgram::Bits)
+    {
+        pio_sm_exec(pio, sm, pio_encode_mov_not(pio_y, pio_null)); // bit count starts at 0
+    }
+    else if (program == WiegandRxProgram::Edges)
+    {
+        pio_sm_exec(pio, sm, pio_encode_mov(pio_isr, pio_null)); // counter starts at 0
+    }
 }
@@ -2,7 +2,36 @@
 
 #include "wiegand_rx2pio.h"
 
+// SM clock cycles per wiegand_rx2 counter tick (its sampling loop, see wiegand_rx2.pio).
+// wiegand_rx_pulse ticks at the same rate.
+constexpr uint kWiegandRx2CyclesPerTick = 9;
+
+// wiegand_rx2 glitch filter: a level change is reported once it has been sampled on this many
+// consecutive ticks (1 = every change is an edge).
+constexpr uint kWiegandRx2MaxFilterSamples = 32;
+
+// Which PIO capture program a port runs.
+enum class WiegandRxProgram : uint8_t
+{
+    Edges,  // wiegand_rx2: one (timestamp << 2) | levels word per level change
+    Pulses, // wiegand_rx_pulse: one line/fall/rise word per bit
+    Bits,   // wiegand_rx_bits: 32 frame bits per word, then a partial word and a bit count
+};
+
+// Load program into pio on first use and share it between that block's SMs; each acquire
+// must be paired with a release. Returns the program offset, or -1 if it does not fit.
+int wiegand_rx_program_acquire(PIO pio, WiegandRxProgram program);
+void wiegand_rx_program_release(PIO pio, WiegandRxProgram program);
+
 // Helper to configure the state machine for Wiegand RX on a single pin.
-// pin is the GPIO to sample; clk_div sets the SM clock divider.
-void wiegand_rx2_program_init(PIO pio, uint sm, uint offset, uint pin, float clk_div);
+// pin is the GPIO to sample; clk_div sets the SM clock divider; filter_samples only
+// applies to wiegand_rx2.
+void wiegand_rx2_program_init(PIO pio, uint sm, uint offset, uint pin, float clk_div,
+                              WiegandRxProgram program = WiegandRxProgram::Edges,
+                              uint filter_samples = 1);
+
+// Where the SM starts (and restarts) in the program at offset.
+uint wiegand_rx_program_entry(WiegandRxProgram program, uint offset);
 
+// Change a running wiegand_rx2 SM's glitch filter (1..kWiegandRx2MaxFilterSamples).
+void wiegand_rx2_set_filter(PIO pio, uint sm, uint filter_samples);
@@ -12,39 +12,40 @@
 // wiegand_rx2 //
 // ----------- //
 
-#define wiegand_rx2_wrap_target 0
-#define wiegand_rx2_wrap 19
-#define wiegand_rx2_pio_version 0
+#define wiegand_rx2_wrap_target 13
+#define wiegand_rx2_wrap 18
+#define wiegand_rx2_pio_version 1
+
+#define wiegand_rx2_offset_start 6u
 
 static const uint16_t wiegand_rx2_program_instructions[] = {
+    0xa026, //  0: mov    x, isr
+    0x000d, //  1: jmp    13
+    0x00e4, //  2: jmp    !osre, 4
+    0xa0e3, //  3: mov    osr, null
+    0x6061, //  4: out    null, 1
+    0x00e0, //  5: jmp    !osre, 0
+    0xa040, //  6: mov    y, pins
+    0xa026, //  7: mov    x, isr
+    0x403e, //  8: in     x, 30
+    0x4042, //  9: in     y, 2
+    0x8020, // 10: push   block
+    0x6060, // 11: out    null, 32
+    0x034d, // 12: jmp    x--, 13                [3]
             //     .wrap_target
-    0xe020, //  0: set    x, 0
-    0xa0c3, //  1: mov    isr, null
-    0x4002, //  2: in     pins, 2
-    0xa046, //  3: mov    y, isr
-    0x0045, //  4: jmp    x--, 5
-    0xa2e1, //  5: mov    osr, x                 [2]
-    0xa0c3, //  6: mov    isr, null
-    0x4002, //  7: in     pins, 2
-    0xa026, //  8: mov    x, isr
-    0x00ac, //  9: jmp    x != y, 12
-    0xa027, // 10: mov    x, osr
-    0x0004, // 11: jmp    4
-    0xa041, // 12: mov    y, x
-    0xa0c3, // 13: mov    isr, null
-    0x40fe, // 14: in     osr, 30
-    0x4042, // 15: in     y, 2
-    0xc010, // 16: irq    nowait 0 rel
-    0x8020, // 17: push   block
-    0xa027, // 18: mov    x, osr
-    0x0004, // 19: jmp    4
+    0x004e, // 13: jmp    x--, 14
+    0xa0c1, // 14: mov    isr, x
+    0xa020, // 15: mov    x, pins
+    0x00a2, // 16: jmp    x != y, 2
+    0x03e7, // 17: jmp    !osre, 7               [3]
+    0xa026, // 18: mov    x, isr
             //     .wrap
 };
 
 #if !PICO_NO_HARDWARE
 static const struct pio_program wiegand_rx2_program = {
     .instructions = wiegand_rx2_program_instructions,
-    .length = 20,
+    .length = 19,
     .origin = -1,
     .pio_version = wiegand_rx2_pio_version,
 #if PICO_PIO_VERSION > 0
@@ -0,0 +1,49 @@
+// -------------------------------------------------- //
+// This file is autogenerated by pioasm; do not edit! //
+// -------------------------------------------------- //
+
+#pragma once
+
+#if !PICO_NO_HARDWARE
+#include "hardware/pio.h"
+#endif
+
+// --------------- //
+// wiegand_rx_bits //
+// --------------- //
+
+#define wiegand_rx_bits_wrap_target 0
+#define wiegand_rx_bits_wrap 7
+#define wiegand_rx_bits_pio_version 1
+
+static const uint16_t wiegand_rx_bits_program_instructions[] = {
+            //     .wrap_target
+    0xa020, //  0: mov    x, pins
+    0x0023, //  1: jmp    !x, 3
+    0x00c0, //  2: jmp    pin, 0
+    0x4001, //  3: in     pins, 1
+    0x0085, //  4: jmp    y--, 5
+    0xc010, //  5: irq    nowait 0 rel
+    0x20a0, //  6: wait   1 pin, 0
+    0x20e0, //  7: wait   1 jmppin
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program wiegand_rx_bits_program = {
+    .instructions = wiegand_rx_bits_program_instructions,
+    .length = 8,
+    .origin = -1,
+    .pio_version = wiegand_rx_bits_pio_version,
+#if PICO_PIO_VERSION > 0
+    .used_gpio_ranges = 0x0
+#endif
+};
+
+static inline pio_sm_config wiegand_rx_bits_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + wiegand_rx_bits_wrap_target, offset + wiegand_rx_bits_wrap);
+    return c;
+}
+#endif
+
@@ -3,17 +3,26 @@
 #include <cstring>
 
 RxLogBuffer g_rx_log_buffer;
+RxMessageQueue g_rx_queue;
 
 RxLogBuffer::RxLogBuffer() : ring_{}, head_(0), count_(0) {}
 
 void RxLogBuffer::clear()
 {
+    for (size_t i = 0; i < count_; ++i)
+    {
+        ring_[(head_ + kCapacity - 1 - i) % kCapacity].release();
+    }
     head_ = 0;
     count_ = 0;
 }
 
 bool RxLogBuffer::push(const RxMessage &msg)
 {
+    if (count_ == kCapacity)
+    {
+        ring_[head_].release(); // the oldest entry
+    }
     ring_[head_] = msg;
     head_ = (head_ + 1) % kCapacity;
     if (count_ < kCapacity)
@@ -3,24 +3,82 @@
 #include <cstddef>
 #include <cstdint>
 
+#include "spsc_queue.h"
+#include "wiegand_compliance.h"
+#include "wiegand_frame.h"
+
+// Min, average and max of a timing value over a frame, in nanoseconds (all 0 if none).
+struct TimingSummary
+{
+    uint32_t min;
+    uint32_t avg;
+    uint32_t max;
+};
+
 // Raw capture of a single Wiegand RX frame along with timing metadata.
 struct RxMessage
 {
-    uint8_t port_id;      // 0 = A, 1 = B, 2 = C
+    uint8_t port_id;      // index into the port table, 0 = 'a' ... kMaxPorts-1
     uint32_t bit_count;   // number of bits captured
+    bool truncated;       // more bits arrived than the frame buffers hold
+    uint8_t errors;       // WiegandDecoder::kError* bits
 
-    // Pulse width statistics (active-low pulses on either line), in timer ticks.
+    // Pulse width statistics (active-low pulses on either line), in nanoseconds.
     uint32_t pulse_min;
     uint32_t pulse_avg;
     uint32_t pulse_max;
 
-    // Gap between pulses, in timer ticks.
+    // Gap between pulses, in nanoseconds.
     uint32_t inter_min;
     uint32_t inter_avg;
     uint32_t inter_max;
 
-    uint8_t data_bytes;    // length of data[] in bytes
-    uint8_t data[32];      // up to 256 bits, MSB-first, right-aligned
+    // The same split up: pulses by line (D0, D1), and gaps by the bits either side
+    // (0->0, 0->1, 1->0, 1->1), which shows a line that is slow to fall or to recover.
+    TimingSummary pulse_line[2];
+    TimingSummary gap_bits[4];
+
+    // Compliance verdict against the port's timing limits (see WiegandPort::set_compliance),
+    // with how often each rule was broken in this frame. checked is false while disabled.
+    bool checked;
+    bool compliant;
+    uint16_t violations[kComplianceRules];
+
+    // First and last edge on the 64-bit system timer (us since boot). With wiegand_rx2 these
+    // come from the unwrapped PIO timestamps, so they are tick-accurate and comparable between
+    // ports that share the RX timebase. The pulse and bit programs only give the time the
+    // capture path last saw activity (the last FIFO interrupt, or the last poll) for both.
+    uint64_t start_us;
+    uint64_t end_us;
+    // The same two edges as unwrapped receiver ticks since the port's counter started, at the
+    // port's full resolution (see WiegandPort::tick_ns). Ports in a synced timebase count
+    // from the same instant. 0 outside the wiegand_rx2 program.
+    uint64_t start_tick;
+    uint64_t end_tick;
+
+    // Card format the bits decode as (see wiegand_format.h) and its fields.
+    uint8_t format;        // index into kWiegandFormats, or kWiegandFormatRaw
+    uint8_t parity_errors; // bit i set: parity group i of the format failed
+    bool inverted;         // fields read from the inverted bits: D0/D1 look swapped
+    uint32_t facility;
+    uint32_t card;
+
+    // The bits, MSB-first and right-aligned: in data[] when they fit, else in a borrowed
+    // g_long_frames slot that goes back when the message is dropped (see release()).
+    uint8_t data_bytes;    // length of the bits in bytes
+    uint8_t long_frame;    // 1 + g_long_frames slot holding the bits, 0 if they are in data[]
+    uint8_t data[kWiegandInlineFrameBytes];
+
+    const uint8_t *bits() const
+    {
+        return long_frame ? g_long_frames.data(long_frame - 1) : data;
+    }
+
+    void release()
+    {
+        g_long_frames.free(static_cast<int>(long_frame) - 1);
+        long_frame = 0;
+    }
 };
 
 // Fixed-size ring buffer for recent RX messages shared across ports.
@@ -31,6 +89,8 @@ public:
 
     void clear();
     bool push(const RxMessage &msg);                       // overwrites oldest when full
+    // Dropping an entry (clear, or push overwriting it) releases its long frame slot, so
+    // copies read back stay valid only until then.
     size_t size() const;
     size_t capacity() const;
 
@@ -49,3 +109,8 @@ private:
 };
 
 extern RxLogBuffer g_rx_log_buffer;
+
+// Decoded frames on their way from the RX context (core1 in dual-core builds) to the
+// main loop, which does the terminal, log and LED work.
+using RxMessageQueue = SpscQueue<RxMessage, 16>;
+extern RxMessageQueue g_rx_queue;
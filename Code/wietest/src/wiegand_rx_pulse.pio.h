@@ -0,0 +1,52 @@
+// -------------------------------------------------- //
+// This file is autogenerated by pioasm; do not edit! //
+// -------------------------------------------------- //
+
+#pragma once
+
+#if !PICO_NO_HARDWARE
+#include "hardware/pio.h"
+#endif
+
+// ---------------- //
+// wiegand_rx_pulse //
+// ---------------- //
+
+#define wiegand_rx_pulse_wrap_target 0
+#define wiegand_rx_pulse_wrap 10
+#define wiegand_rx_pulse_pio_version 0
+
+static const uint16_t wiegand_rx_pulse_program_instructions[] = {
+            //     .wrap_target
+    0x0041, //  0: jmp    x--, 1
+    0xa0e8, //  1: mov    osr, ~pins
+    0x6042, //  2: out    y, 2
+    0x0560, //  3: jmp    !y, 0                  [5]
+    0x4042, //  4: in     y, 2
+    0x402f, //  5: in     x, 15
+    0x0047, //  6: jmp    x--, 7
+    0xa0e8, //  7: mov    osr, ~pins
+    0x6042, //  8: out    y, 2
+    0x0586, //  9: jmp    y--, 6                 [5]
+    0x402f, // 10: in     x, 15
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program wiegand_rx_pulse_program = {
+    .instructions = wiegand_rx_pulse_program_instructions,
+    .length = 11,
+    .origin = -1,
+    .pio_version = wiegand_rx_pulse_pio_version,
+#if PICO_PIO_VERSION > 0
+    .used_gpio_ranges = 0x0
+#endif
+};
+
+static inline pio_sm_config wiegand_rx_pulse_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + wiegand_rx_pulse_wrap_target, offset + wiegand_rx_pulse_wrap);
+    return c;
+}
+#endif
+
@@ -0,0 +1,226 @@
+// Host-side round trips of EdgeStore: pio test -e native
+#include <unity.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "edge_store.h"
+
+namespace {
+
+constexpr uint32_t kTimestampMask = (1u << 30) - 1;
+
+// A store over its own blocks.
+struct TestStore
+{
+    TestStore(uint32_t block_count, uint32_t block_bytes)
+        : storage(block_count, std::vector<uint8_t>(block_bytes)), blocks(block_count)
+    {
+        for (uint32_t i = 0; i < block_count; ++i)
+        {
+            blocks[i] = storage[i].data();
+        }
+        store.attach(blocks.data(), block_count, block_bytes);
+    }
+
+    std::vector<std::vector<uint8_t>> storage;
+    std::vector<uint8_t *> blocks;
+    EdgeStore store;
+};
+
+// Deterministic xorshift, so a failure reproduces.
+uint32_t next_random(uint32_t &state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+uint32_t record(uint32_t ts, uint32_t levels)
+{
+    return ((ts & kTimestampMask) << 2) | (levels & 0x3);
+}
+
+// Append every word (all must fit), then check the store reads back the ones it still holds.
+void append_all(EdgeStore &store, const std::vector<uint32_t> &words)
+{
+    for (uint32_t word : words)
+    {
+        TEST_ASSERT_TRUE(store.append(word));
+    }
+}
+
+void check_tail(const EdgeStore &store, const std::vector<uint32_t> &words)
+{
+    TEST_ASSERT_EQUAL_UINT32(words.size(), store.appended());
+    TEST_ASSERT_EQUAL_UINT32(store.appended() - store.first_index(), store.size());
+    EdgeStore::Reader reader = store.reader();
+    uint32_t word = 0;
+    for (uint32_t i = store.first_index(); i < words.size(); ++i)
+    {
+        TEST_ASSERT_TRUE(reader.next(word));
+        TEST_ASSERT_EQUAL_HEX32(words[i], word);
+    }
+    TEST_ASSERT_FALSE(reader.next(word));
+    if (!words.empty())
+    {
+        TEST_ASSERT_EQUAL_HEX32(words.back(), store.last_word());
+    }
+}
+
+} // namespace
+
+void setUp() {}
+void tearDown() {}
+
+void test_random_deltas()
+{
+    // Deltas from 0 to the full 30-bit range, in runs of steady spacing and single jumps.
+    TestStore t(64, 256);
+    std::vector<uint32_t> words;
+    uint32_t state = 0x12345678u;
+    uint32_t ts = kTimestampMask;
+    uint32_t levels = 3;
+    uint32_t spacing = 100;
+    for (int i = 0; i < 2000; ++i)
+    {
+        const uint32_t r = next_random(state);
+        if ((r & 0xF) == 0)
+        {
+            spacing = next_random(state) >> (2 + (r >> 4) % 30);
+        }
+        const uint32_t delta = ((r & 0x30) == 0) ? (next_random(state) & kTimestampMask)
+                                                 : spacing + (r >> 8) % 3;
+        ts = (ts - delta) & kTimestampMask;
+        levels ^= 1u + (r >> 28) % 3; // one or both lines change
+        words.push_back(record(ts, levels));
+    }
+    append_all(t.store, words);
+    TEST_ASSERT_EQUAL_UINT32(0, t.store.first_index());
+    check_tail(t.store, words);
+}
+
+void test_timestamp_wrap()
+{
+    // The PIO counter counts down and wraps from 0 to 2^30 - 1 mid-train.
+    TestStore t(4, 256);
+    std::vector<uint32_t> words;
+    uint32_t ts = 450;
+    for (int i = 0; i < 40; ++i)
+    {
+        words.push_back(record(ts, (i & 1) ? 3 : 2));
+        ts = (ts - ((i & 1) ? 40 : 60)) & kTimestampMask;
+    }
+    words.push_back(record(0, 3));
+    words.push_back(record(kTimestampMask, 1));
+    words.push_back(record(kTimestampMask - 5, 3));
+    append_all(t.store, words);
+    check_tail(t.store, words);
+}
+
+void test_level_only_changes()
+{
+    // Zero deltas: levels changing under one timestamp, and repeats of the same word.
+    TestStore t(4, 256);
+    std::vector<uint32_t> words = {record(1000, 3), record(1000, 2), record(1000, 0),
+                                   record(1000, 1), record(1000, 3), record(1000, 3),
+                                   record(990, 3),  record(990, 3),  record(990, 0),
+                                   record(0, 0),    record(0, 3)};
+    append_all(t.store, words);
+    check_tail(t.store, words);
+}
+
+void test_block_rollover_drops_oldest()
+{
+    // Far more than fits: whole blocks go from the oldest end and the rest reads back intact.
+    constexpr uint32_t kBlocks = 4;
+    constexpr uint32_t kBlockBytes = 32;
+    TestStore t(kBlocks, kBlockBytes);
+    std::vector<uint32_t> words;
+    uint32_t state = 0xCAFEF00Du;
+    uint32_t ts = 5000;
+    for (int i = 0; i < 500; ++i)
+    {
+        ts = (ts - 50 - next_random(state) % 200) & kTimestampMask;
+        words.push_back(record(ts, (i & 1) ? 3 : 1 + (i & 2) / 2));
+        TEST_ASSERT_TRUE(t.store.append(words.back()));
+        TEST_ASSERT_TRUE(t.store.size() > 0);
+    }
+    TEST_ASSERT_TRUE(t.store.first_index() > 0);
+    // A record costs at least a byte, so the ring cannot hold more than this.
+    TEST_ASSERT_TRUE(t.store.size() <= kBlocks * kBlockBytes);
+    check_tail(t.store, words);
+
+    t.store.clear();
+    TEST_ASSERT_EQUAL_UINT32(0, t.store.size());
+    TEST_ASSERT_EQUAL_UINT32(0, t.store.appended());
+    uint32_t word = 0;
+    EdgeStore::Reader reader = t.store.reader();
+    TEST_ASSERT_FALSE(reader.next(word));
+}
+
+void test_keep_refuses_to_drop_trigger()
+{
+    TestStore t(4, 32);
+    std::vector<uint32_t> words;
+    uint32_t ts = 100000;
+    auto next_word = [&]() {
+        ts = (ts - 97) & kTimestampMask;
+        return record(ts, (words.size() & 1) ? 3 : 2);
+    };
+    for (int i = 0; i < 10; ++i)
+    {
+        words.push_back(next_word());
+        TEST_ASSERT_TRUE(t.store.append(words.back()));
+    }
+    const uint32_t trigger = 3;
+    t.store.keep(trigger);
+
+    // Fill up until the ring would have to give up the kept record's block.
+    uint32_t refused = 0;
+    for (int i = 0; i < 1000 && refused == 0; ++i)
+    {
+        const uint32_t word = next_word();
+        if (t.store.append(word))
+        {
+            words.push_back(word);
+        }
+        else
+        {
+            refused = word;
+        }
+    }
+    TEST_ASSERT_TRUE(refused != 0);
+    TEST_ASSERT_TRUE(t.store.first_index() <= trigger);
+    TEST_ASSERT_EQUAL_HEX32(words.back(), t.store.last_word());
+    check_tail(t.store, words);
+    // Refusals keep refusing and store nothing.
+    TEST_ASSERT_FALSE(t.store.append(refused));
+    TEST_ASSERT_EQUAL_UINT32(words.size(), t.store.appended());
+
+    t.store.clear_keep();
+    words.push_back(refused);
+    TEST_ASSERT_TRUE(t.store.append(refused));
+    TEST_ASSERT_TRUE(t.store.first_index() > trigger);
+    check_tail(t.store, words);
+}
+
+void test_unattached_store_refuses()
+{
+    EdgeStore store;
+    TEST_ASSERT_FALSE(store.append(record(10, 3)));
+    TEST_ASSERT_EQUAL_UINT32(0, store.size());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_random_deltas);
+    RUN_TEST(test_timestamp_wrap);
+    RUN_TEST(test_level_only_changes);
+    RUN_TEST(test_block_rollover_drops_oldest);
+    RUN_TEST(test_keep_refuses_to_drop_trigger);
+    RUN_TEST(test_unattached_store_refuses);
+    return UNITY_END();
+}